@@ -0,0 +1,105 @@
+#ifndef MYSTEP60_BANDED_CHOLESKY_H
+#define MYSTEP60_BANDED_CHOLESKY_H
+
+// cholesky factorization of a symmetric matrix whit a band of half width b around the diagonal. The factor keep
+// the same band so the factorization cost n*b*b and each solve n*b, it is used as preconditioner of the schur
+// complement when the embedded dofs are numbered along the curve.
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+namespace mystep60 {
+
+    class BandedCholesky {
+    public:
+        // n x n matrix whit the entries (i,j), |i-j| <= bandwidth, all zero
+        void reinit(const std::size_t n, const std::size_t bandwidth) {
+            size = n;
+            half_bandwidth = std::min(bandwidth, n > 0 ? n - 1 : 0);
+            band.assign(size * (half_bandwidth + 1), 0.);
+            factorized = false;
+        }
+
+        std::size_t n() const {
+            return size;
+        }
+
+        std::size_t bandwidth() const {
+            return half_bandwidth;
+        }
+
+        bool is_factorized() const {
+            return factorized;
+        }
+
+        // entry (i,j) of the lower part ( j <= i <= j + bandwidth), the columns are contiguous
+        double &operator()(const std::size_t i, const std::size_t j) {
+            return band[j * (half_bandwidth + 1) + (i - j)];
+        }
+
+        // replace the band by the factor L of A = L L^T, return false if a pivot is not positive
+        bool factorize() {
+            const std::size_t width = half_bandwidth + 1;
+            for (std::size_t j = 0; j < size; ++j) {
+                double *column = &band[j * width];
+                const std::size_t last = std::min(j + half_bandwidth, size - 1);
+                // remove the contribution of the previous columns that reach the row j
+                for (std::size_t k = (j > half_bandwidth ? j - half_bandwidth : 0); k < j; ++k) {
+                    const double *column_k = &band[k * width];
+                    const double l_jk = column_k[j - k];
+                    const std::size_t last_k = std::min(k + half_bandwidth, last);
+                    for (std::size_t i = j; i <= last_k; ++i)
+                        column[i - j] -= column_k[i - k] * l_jk;
+                }
+                if (!(column[0] > 0.)) {
+                    factorized = false;
+                    return false;
+                }
+                column[0] = std::sqrt(column[0]);
+                for (std::size_t i = j + 1; i <= last; ++i)
+                    column[i - j] /= column[0];
+            }
+            factorized = true;
+            return true;
+        }
+
+        // dst = A^-1 src whit the factor, same interface than the preconditioners of deal.II
+        template<typename VectorType>
+        void vmult(VectorType &dst, const VectorType &src) const {
+            const std::size_t width = half_bandwidth + 1;
+            // L y = src
+            for (std::size_t j = 0; j < size; ++j)
+                dst[j] = src[j];
+            for (std::size_t j = 0; j < size; ++j) {
+                const double *column = &band[j * width];
+                dst[j] /= column[0];
+                const std::size_t last = std::min(j + half_bandwidth, size - 1);
+                for (std::size_t i = j + 1; i <= last; ++i)
+                    dst[i] -= column[i - j] * dst[j];
+            }
+            // L^T dst = y
+            for (std::size_t j = size; j-- > 0;) {
+                const double *column = &band[j * width];
+                const std::size_t last = std::min(j + half_bandwidth, size - 1);
+                double value = dst[j];
+                for (std::size_t i = j + 1; i <= last; ++i)
+                    value -= column[i - j] * dst[i];
+                dst[j] = value / column[0];
+            }
+        }
+
+        std::size_t memory_consumption() const {
+            return sizeof(*this) + band.capacity() * sizeof(double);
+        }
+
+    private:
+        std::size_t size = 0;
+        std::size_t half_bandwidth = 0;
+        std::vector<double> band;
+        bool factorized = false;
+    };
+}
+
+#endif
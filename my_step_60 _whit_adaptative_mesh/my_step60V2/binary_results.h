@@ -0,0 +1,131 @@
+#ifndef MYSTEP60_BINARY_RESULTS_H
+#define MYSTEP60_BINARY_RESULTS_H
+
+// compact binary dump of the results of mystep_60V2 and the loader used by the post-processing tools.
+// The file is a fixed size header followed by raw little-endian arrays of double, each array start on a
+// 8 bytes boundary so the loader can mmap the file and give direct pointers on the data whitout parsing.
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace mystep60 {
+
+    struct BinaryResultsHeader {
+        // "MYSTEP60" whitout the final 0
+        char magic[8];
+        std::uint32_t version;
+        // number of coordinates of each support point
+        std::uint32_t spacedim;
+        std::uint64_t n_embedding_dofs;
+        std::uint64_t n_embedded_dofs;
+        // position in bytes from the start of the file of each array
+        std::uint64_t solution_offset;          // n_embedding_dofs values
+        std::uint64_t embedding_points_offset;  // n_embedding_dofs * spacedim coordinates, point by point
+        std::uint64_t lambda_offset;            // n_embedded_dofs values
+        std::uint64_t sub_domain_value_offset;  // n_embedded_dofs values
+        std::uint64_t embedded_points_offset;   // n_embedded_dofs * spacedim coordinates, point by point
+    };
+
+    constexpr char binary_results_magic[8] = {'M', 'Y', 'S', 'T', 'E', 'P', '6', '0'};
+    constexpr std::uint32_t binary_results_version = 1;
+
+    // the arrays are written as they are in memory, so the format is only valid on little endian machines
+    inline bool host_is_little_endian() {
+        const std::uint16_t one = 1;
+        unsigned char first_byte;
+        std::memcpy(&first_byte, &one, 1);
+        return first_byte == 1;
+    }
+
+    // compute the offsets of all the arrays from the sizes stored in the header
+    inline void set_binary_results_layout(BinaryResultsHeader &header) {
+        std::memcpy(header.magic, binary_results_magic, sizeof(header.magic));
+        header.version = binary_results_version;
+        std::uint64_t offset = sizeof(BinaryResultsHeader);
+        offset = (offset + 7) / 8 * 8;
+        header.solution_offset = offset;
+        offset += header.n_embedding_dofs * sizeof(double);
+        header.embedding_points_offset = offset;
+        offset += header.n_embedding_dofs * header.spacedim * sizeof(double);
+        header.lambda_offset = offset;
+        offset += header.n_embedded_dofs * sizeof(double);
+        header.sub_domain_value_offset = offset;
+        offset += header.n_embedded_dofs * sizeof(double);
+        header.embedded_points_offset = offset;
+    }
+
+    // size of the whole file described by the header
+    inline std::uint64_t binary_results_size(const BinaryResultsHeader &header) {
+        return header.embedded_points_offset + header.n_embedded_dofs * header.spacedim * sizeof(double);
+    }
+
+    // read only view of a binary result file, the file stay mapped as long as the object exist
+    class BinaryResults {
+    public:
+        explicit BinaryResults(const std::string &filename) {
+            if (!host_is_little_endian())
+                throw std::runtime_error("The binary results can only be read on little endian machines.");
+
+            const int file = open(filename.c_str(), O_RDONLY);
+            if (file < 0)
+                throw std::runtime_error("Can not open the binary results " + filename);
+            struct stat status;
+            if (fstat(file, &status) != 0 || status.st_size < static_cast<off_t>(sizeof(BinaryResultsHeader))) {
+                close(file);
+                throw std::runtime_error("The file " + filename + " is too small to be a binary result.");
+            }
+            size = static_cast<std::size_t>(status.st_size);
+            data = mmap(nullptr, size, PROT_READ, MAP_SHARED, file, 0);
+            // the mapping stay valid after the file is closed
+            close(file);
+            if (data == MAP_FAILED)
+                throw std::runtime_error("Can not map the binary results " + filename);
+
+            if (std::memcmp(header().magic, binary_results_magic, sizeof(binary_results_magic)) != 0 ||
+                header().version != binary_results_version || binary_results_size(header()) > size) {
+                munmap(data, size);
+                throw std::runtime_error("The file " + filename + " is not a valid binary result.");
+            }
+        }
+
+        ~BinaryResults() {
+            munmap(data, size);
+        }
+
+        BinaryResults(const BinaryResults &) = delete;
+
+        BinaryResults &operator=(const BinaryResults &) = delete;
+
+        const BinaryResultsHeader &header() const {
+            return *static_cast<const BinaryResultsHeader *>(data);
+        }
+
+        const double *solution() const { return array(header().solution_offset); }
+
+        // coordinates of the support point i are embedding_points()[i*spacedim ... i*spacedim + spacedim-1]
+        const double *embedding_points() const { return array(header().embedding_points_offset); }
+
+        const double *lambda() const { return array(header().lambda_offset); }
+
+        const double *sub_domain_value() const { return array(header().sub_domain_value_offset); }
+
+        const double *embedded_points() const { return array(header().embedded_points_offset); }
+
+    private:
+        const double *array(const std::uint64_t offset) const {
+            return reinterpret_cast<const double *>(static_cast<const char *>(data) + offset);
+        }
+
+        void *data;
+        std::size_t size;
+    };
+}
+
+#endif
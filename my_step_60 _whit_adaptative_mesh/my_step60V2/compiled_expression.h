@@ -0,0 +1,363 @@
+#ifndef MYSTEP60_COMPILED_EXPRESSION_H
+#define MYSTEP60_COMPILED_EXPRESSION_H
+
+// expression of a parsed function translated once in a list of operations ( bytecode) that is run on whole
+// batches of points, instead of interpreting the text again for each point like muparser. It know the usual
+// muparser syntax: + - * / ^, the unary sign, parenthesis, numbers, variables, constants and the common
+// functions. Anything else ( comparison, if, ternary ...) throw std::invalid_argument so the caller can
+// fall back on muparser.
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace mystep60 {
+
+    class CompiledExpression {
+    public:
+        CompiledExpression(const std::string &expression, const std::vector<std::string> &variables,
+                           const std::map<std::string, double> &constants)
+                : text(expression), variables(variables), constants(constants) {
+            position = 0;
+            parse_sum();
+            skip_spaces();
+            if (position != text.size())
+                fail("unexpected '" + text.substr(position, 1) + "'");
+
+            // depth of the stack needed by the program
+            unsigned int depth = 0;
+            for (const auto &instruction : program) {
+                if (instruction.op == Op::constant || instruction.op == Op::variable)
+                    ++depth;
+                else if (instruction.op != Op::negate && instruction.op != Op::function1)
+                    --depth;
+                stack_size = std::max(stack_size, depth);
+            }
+        }
+
+        // variables[v][i] is the value of the variable v at the point i
+        void evaluate(const std::vector<const double *> &variable_values, const std::size_t n_points,
+                      double *values) const {
+            // small chunks so the whole stack stay in the cache
+            const std::size_t chunk = std::min<std::size_t>(256, n_points);
+            std::vector<double> stack(stack_size * chunk);
+            for (std::size_t begin = 0; begin < n_points; begin += chunk) {
+                const std::size_t n = std::min(chunk, n_points - begin);
+                unsigned int top = 0;
+                for (const auto &instruction : program) {
+                    // first free place of the stack, the value on top is just before
+                    double *next = stack.data() + top * chunk;
+                    switch (instruction.op) {
+                        case Op::constant:
+                            std::fill(next, next + n, instruction.value);
+                            ++top;
+                            break;
+                        case Op::variable:
+                            std::copy(variable_values[instruction.index] + begin,
+                                      variable_values[instruction.index] + begin + n, next);
+                            ++top;
+                            break;
+                        case Op::negate: {
+                            double *a = next - chunk;
+                            for (std::size_t i = 0; i < n; ++i)
+                                a[i] = -a[i];
+                            break;
+                        }
+                        case Op::function1:
+                            instruction.function1(next - chunk, n);
+                            break;
+                        default: {
+                            // binary operation on the two values on top of the stack
+                            double *a = next - 2 * chunk;
+                            const double *b = next - chunk;
+                            switch (instruction.op) {
+                                case Op::add:
+                                    for (std::size_t i = 0; i < n; ++i)
+                                        a[i] += b[i];
+                                    break;
+                                case Op::subtract:
+                                    for (std::size_t i = 0; i < n; ++i)
+                                        a[i] -= b[i];
+                                    break;
+                                case Op::multiply:
+                                    for (std::size_t i = 0; i < n; ++i)
+                                        a[i] *= b[i];
+                                    break;
+                                case Op::divide:
+                                    for (std::size_t i = 0; i < n; ++i)
+                                        a[i] /= b[i];
+                                    break;
+                                default:
+                                    instruction.function2(a, b, n);
+                            }
+                            --top;
+                        }
+                    }
+                }
+                std::copy(stack.data(), stack.data() + n, values + begin);
+            }
+        }
+
+        std::size_t n_instructions() const {
+            return program.size();
+        }
+
+    private:
+        enum class Op {
+            constant, variable, add, subtract, multiply, divide, negate, function1, function2
+        };
+
+        // the functions work on a whole chunk: one indirect call per chunk and a loop the compiler can vectorize
+        using Function1 = void (*)(double *a, std::size_t n);
+        using Function2 = void (*)(double *a, const double *b, std::size_t n);
+
+        struct Instruction {
+            Op op;
+            double value;
+            unsigned int index;
+            Function1 function1;
+            Function2 function2;
+        };
+
+        void fail(const std::string &message) const {
+            throw std::invalid_argument("Can not compile <" + text + ">: " + message);
+        }
+
+        void skip_spaces() {
+            while (position < text.size() && std::isspace(static_cast<unsigned char>(text[position])))
+                ++position;
+        }
+
+        bool accept(const char c) {
+            skip_spaces();
+            if (position < text.size() && text[position] == c) {
+                ++position;
+                return true;
+            }
+            return false;
+        }
+
+        // operations whit only constant operands are done now
+        void emit(const Instruction &instruction) {
+            const std::size_t n = program.size();
+            if ((instruction.op == Op::negate || instruction.op == Op::function1) && n >= 1 &&
+                program[n - 1].op == Op::constant) {
+                double &a = program[n - 1].value;
+                if (instruction.op == Op::negate)
+                    a = -a;
+                else
+                    instruction.function1(&a, 1);
+                return;
+            }
+            if (instruction.op != Op::constant && instruction.op != Op::variable && instruction.op != Op::negate &&
+                instruction.op != Op::function1 && n >= 2 && program[n - 2].op == Op::constant &&
+                program[n - 1].op == Op::constant) {
+                double &a = program[n - 2].value;
+                const double b = program[n - 1].value;
+                switch (instruction.op) {
+                    case Op::add:
+                        a += b;
+                        break;
+                    case Op::subtract:
+                        a -= b;
+                        break;
+                    case Op::multiply:
+                        a *= b;
+                        break;
+                    case Op::divide:
+                        a /= b;
+                        break;
+                    default:
+                        instruction.function2(&a, &b, 1);
+                }
+                program.pop_back();
+                return;
+            }
+            program.push_back(instruction);
+        }
+
+        void emit(const Op op) {
+            emit(Instruction{op, 0., 0, nullptr, nullptr});
+        }
+
+        // sum := product (('+'|'-') product)*
+        void parse_sum() {
+            parse_product();
+            while (true) {
+                if (accept('+')) {
+                    parse_product();
+                    emit(Op::add);
+                } else if (accept('-')) {
+                    parse_product();
+                    emit(Op::subtract);
+                } else
+                    return;
+            }
+        }
+
+        // product := sign (('*'|'/') sign)*
+        void parse_product() {
+            parse_sign();
+            while (true) {
+                if (accept('*')) {
+                    parse_sign();
+                    emit(Op::multiply);
+                } else if (accept('/')) {
+                    parse_sign();
+                    emit(Op::divide);
+                } else
+                    return;
+            }
+        }
+
+        // the sign apply after the power like in muparser: -x^2 = -(x^2)
+        void parse_sign() {
+            if (accept('-')) {
+                parse_sign();
+                emit(Op::negate);
+            } else if (accept('+'))
+                parse_sign();
+            else
+                parse_power();
+        }
+
+        // power := primary ('^' sign)?, right associative
+        void parse_power() {
+            parse_primary();
+            if (accept('^')) {
+                parse_sign();
+                emit(Instruction{Op::function2, 0., 0, nullptr, [](double *a, const double *b, std::size_t n) {
+                    for (std::size_t i = 0; i < n; ++i)
+                        a[i] = std::pow(a[i], b[i]);
+                }});
+            }
+        }
+
+        void parse_primary() {
+            skip_spaces();
+            if (position == text.size())
+                fail("unexpected end");
+
+            if (accept('(')) {
+                parse_sum();
+                if (!accept(')'))
+                    fail("missing ')'");
+                return;
+            }
+
+            const char c = text[position];
+            if (std::isdigit(static_cast<unsigned char>(c)) || c == '.') {
+                char *end;
+                const double value = std::strtod(text.c_str() + position, &end);
+                position = end - text.c_str();
+                emit(Instruction{Op::constant, value, 0, nullptr, nullptr});
+                return;
+            }
+
+            if (!std::isalpha(static_cast<unsigned char>(c)) && c != '_')
+                fail("unexpected '" + std::string(1, c) + "'");
+            const std::size_t start = position;
+            while (position < text.size() &&
+                   (std::isalnum(static_cast<unsigned char>(text[position])) || text[position] == '_'))
+                ++position;
+            const std::string name = text.substr(start, position - start);
+
+            if (accept('(')) {
+                parse_call(name);
+                return;
+            }
+            for (unsigned int v = 0; v < variables.size(); ++v)
+                if (variables[v] == name) {
+                    emit(Instruction{Op::variable, 0., v, nullptr, nullptr});
+                    return;
+                }
+            const auto constant = constants.find(name);
+            if (constant != constants.end()) {
+                emit(Instruction{Op::constant, constant->second, 0, nullptr, nullptr});
+                return;
+            }
+            // constants that muparser always define
+            if (name == "_pi" || name == "_e") {
+                emit(Instruction{Op::constant, name == "_pi" ? std::acos(-1.) : std::exp(1.), 0, nullptr, nullptr});
+                return;
+            }
+            fail("unknown name " + name);
+        }
+
+        // the opening parenthesis is already read
+        void parse_call(const std::string &name) {
+            static const std::map<std::string, Function1> functions1 = {
+                    {"sin",   [](double *a, std::size_t n) { for (std::size_t i = 0; i < n; ++i) a[i] = std::sin(a[i]); }},
+                    {"cos",   [](double *a, std::size_t n) { for (std::size_t i = 0; i < n; ++i) a[i] = std::cos(a[i]); }},
+                    {"tan",   [](double *a, std::size_t n) { for (std::size_t i = 0; i < n; ++i) a[i] = std::tan(a[i]); }},
+                    {"asin",  [](double *a, std::size_t n) { for (std::size_t i = 0; i < n; ++i) a[i] = std::asin(a[i]); }},
+                    {"acos",  [](double *a, std::size_t n) { for (std::size_t i = 0; i < n; ++i) a[i] = std::acos(a[i]); }},
+                    {"atan",  [](double *a, std::size_t n) { for (std::size_t i = 0; i < n; ++i) a[i] = std::atan(a[i]); }},
+                    {"sinh",  [](double *a, std::size_t n) { for (std::size_t i = 0; i < n; ++i) a[i] = std::sinh(a[i]); }},
+                    {"cosh",  [](double *a, std::size_t n) { for (std::size_t i = 0; i < n; ++i) a[i] = std::cosh(a[i]); }},
+                    {"tanh",  [](double *a, std::size_t n) { for (std::size_t i = 0; i < n; ++i) a[i] = std::tanh(a[i]); }},
+                    {"exp",   [](double *a, std::size_t n) { for (std::size_t i = 0; i < n; ++i) a[i] = std::exp(a[i]); }},
+                    {"log",   [](double *a, std::size_t n) { for (std::size_t i = 0; i < n; ++i) a[i] = std::log(a[i]); }},
+                    {"ln",    [](double *a, std::size_t n) { for (std::size_t i = 0; i < n; ++i) a[i] = std::log(a[i]); }},
+                    {"log10", [](double *a, std::size_t n) { for (std::size_t i = 0; i < n; ++i) a[i] = std::log10(a[i]); }},
+                    {"log2",  [](double *a, std::size_t n) { for (std::size_t i = 0; i < n; ++i) a[i] = std::log2(a[i]); }},
+                    {"sqrt",  [](double *a, std::size_t n) { for (std::size_t i = 0; i < n; ++i) a[i] = std::sqrt(a[i]); }},
+                    {"abs",   [](double *a, std::size_t n) { for (std::size_t i = 0; i < n; ++i) a[i] = std::abs(a[i]); }},
+                    {"floor", [](double *a, std::size_t n) { for (std::size_t i = 0; i < n; ++i) a[i] = std::floor(a[i]); }},
+                    {"ceil",  [](double *a, std::size_t n) { for (std::size_t i = 0; i < n; ++i) a[i] = std::ceil(a[i]); }},
+                    {"sign",  [](double *a, std::size_t n) {
+                        for (std::size_t i = 0; i < n; ++i)
+                            a[i] = static_cast<double>((a[i] > 0) - (a[i] < 0));
+                    }}};
+            static const std::map<std::string, Function2> functions2 = {
+                    {"pow",   [](double *a, const double *b, std::size_t n) {
+                        for (std::size_t i = 0; i < n; ++i)
+                            a[i] = std::pow(a[i], b[i]);
+                    }},
+                    {"atan2", [](double *a, const double *b, std::size_t n) {
+                        for (std::size_t i = 0; i < n; ++i)
+                            a[i] = std::atan2(a[i], b[i]);
+                    }},
+                    {"min",   [](double *a, const double *b, std::size_t n) {
+                        for (std::size_t i = 0; i < n; ++i)
+                            a[i] = std::min(a[i], b[i]);
+                    }},
+                    {"max",   [](double *a, const double *b, std::size_t n) {
+                        for (std::size_t i = 0; i < n; ++i)
+                            a[i] = std::max(a[i], b[i]);
+                    }}};
+
+            parse_sum();
+            const auto function1 = functions1.find(name);
+            if (function1 != functions1.end()) {
+                if (!accept(')'))
+                    fail(name + " take one argument");
+                emit(Instruction{Op::function1, 0., 0, function1->second, nullptr});
+                return;
+            }
+            const auto function2 = functions2.find(name);
+            if (function2 != functions2.end()) {
+                if (!accept(',') || (parse_sum(), !accept(')')))
+                    fail(name + " take two arguments");
+                emit(Instruction{Op::function2, 0., 0, nullptr, function2->second});
+                return;
+            }
+            fail("unknown function " + name);
+        }
+
+        const std::string text;
+        const std::vector<std::string> variables;
+        const std::map<std::string, double> constants;
+        std::size_t position;
+
+        std::vector<Instruction> program;
+        unsigned int stack_size = 0;
+    };
+}
+
+#endif
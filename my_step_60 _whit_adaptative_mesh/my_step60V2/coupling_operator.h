@@ -0,0 +1,124 @@
+#ifndef MYSTEP60_COUPLING_OPERATOR_H
+#define MYSTEP60_COUPLING_OPERATOR_H
+
+// products of the coupling matrix Ct ( rows: embedding dofs, columns: embedded dofs) and of its transpose C
+// whitout a second matrix. The values and the rows ( CSR) stay in the SparseMatrix and its SparsityPattern,
+// the operator only add the index arrays of the columns ( CSC) that point in the same values, so C y is done
+// column by column instead of the scattered writes of SparseMatrix::Tvmult. Both products are split in ranges
+// of rows or columns done by the threads of deal.II.
+
+#include <deal.II/base/parallel.h>
+#include <deal.II/lac/sparse_matrix.h>
+#include <deal.II/lac/vector.h>
+
+#include <vector>
+
+namespace mystep60 {
+
+    class CouplingOperator {
+    public:
+        using size_type = dealii::types::global_dof_index;
+
+        // build the index arrays of the columns from the sparsity of the matrix, must be called again when the
+        // sparsity change but not when only the values change
+        void reinit(const dealii::SparseMatrix<double> &coupling_matrix) {
+            matrix = &coupling_matrix;
+            sparsity = &coupling_matrix.get_sparsity_pattern();
+            n_rows = sparsity->n_rows();
+            n_cols = sparsity->n_cols();
+
+            // the entries of each column in the order of the rows
+            column_start.assign(n_cols + 1, 0);
+            for (const auto &entry : *sparsity)
+                ++column_start[entry.column() + 1];
+            for (size_type column = 0; column < n_cols; ++column)
+                column_start[column + 1] += column_start[column];
+            column_rows.resize(sparsity->n_nonzero_elements());
+            column_entries.resize(sparsity->n_nonzero_elements());
+            std::vector<std::size_t> next(column_start.begin(), column_start.end() - 1);
+            for (size_type row = 0; row < n_rows; ++row)
+                for (auto entry = sparsity->begin(row); entry != sparsity->end(row); ++entry) {
+                    const std::size_t position = next[entry->column()]++;
+                    column_rows[position] = row;
+                    column_entries[position] = entry->global_index();
+                }
+        }
+
+        size_type m() const {
+            return n_rows;
+        }
+
+        size_type n() const {
+            return n_cols;
+        }
+
+        // dst = Ct src, src on the embedded dofs
+        void vmult(dealii::Vector<double> &dst, const dealii::Vector<double> &src) const {
+            apply_rows(dst, src, false);
+        }
+
+        void vmult_add(dealii::Vector<double> &dst, const dealii::Vector<double> &src) const {
+            apply_rows(dst, src, true);
+        }
+
+        // dst = C src, src on the embedding dofs
+        void Tvmult(dealii::Vector<double> &dst, const dealii::Vector<double> &src) const {
+            apply_columns(dst, src, false);
+        }
+
+        void Tvmult_add(dealii::Vector<double> &dst, const dealii::Vector<double> &src) const {
+            apply_columns(dst, src, true);
+        }
+
+        std::size_t memory_consumption() const {
+            return sizeof(*this) + (column_start.capacity() + column_entries.capacity()) * sizeof(std::size_t) +
+                   column_rows.capacity() * sizeof(size_type);
+        }
+
+    private:
+        const double *values() const {
+            return column_entries.empty() ? nullptr : &matrix->global_entry(0);
+        }
+
+        void apply_rows(dealii::Vector<double> &dst, const dealii::Vector<double> &src, const bool add) const {
+            const double *value = values();
+            dealii::parallel::apply_to_subranges(size_type(0), n_rows, [&](const size_type begin,
+                                                                          const size_type end) {
+                for (size_type row = begin; row < end; ++row) {
+                    double sum = add ? dst(row) : 0.;
+                    for (auto entry = sparsity->begin(row); entry != sparsity->end(row); ++entry)
+                        sum += value[entry->global_index()] * src(entry->column());
+                    dst(row) = sum;
+                }
+            }, grain_size);
+        }
+
+        void apply_columns(dealii::Vector<double> &dst, const dealii::Vector<double> &src, const bool add) const {
+            const double *value = values();
+            dealii::parallel::apply_to_subranges(size_type(0), n_cols, [&](const size_type begin,
+                                                                          const size_type end) {
+                for (size_type column = begin; column < end; ++column) {
+                    double sum = add ? dst(column) : 0.;
+                    for (std::size_t k = column_start[column]; k < column_start[column + 1]; ++k)
+                        sum += value[column_entries[k]] * src(column_rows[k]);
+                    dst(column) = sum;
+                }
+            }, grain_size);
+        }
+
+        // rows or columns done by one task
+        static constexpr unsigned int grain_size = 512;
+
+        const dealii::SparseMatrix<double> *matrix = nullptr;
+        const dealii::SparsityPattern *sparsity = nullptr;
+        size_type n_rows = 0;
+        size_type n_cols = 0;
+        // positions are std::size_t like in SparsityPattern, the number of entries can pass 2^32
+        std::vector<std::size_t> column_start;
+        std::vector<size_type> column_rows;
+        // position of the entry in the values of the matrix
+        std::vector<std::size_t> column_entries;
+    };
+}
+
+#endif
@@ -1,6 +1,9 @@
 #include <deal.II/base/logstream.h>
 #include <deal.II/base/utilities.h>
 #include <deal.II/base/timer.h>
+#include <deal.II/base/thread_management.h>
+#include <deal.II/base/mpi.h>
+#include <deal.II/base/vectorization.h>
 #include <deal.II/lac/sparse_ilu.h>
 // define public parameter
 #include <deal.II/base/parameter_acceptor.h>
@@ -16,12 +19,16 @@
 #include <deal.II/fe/fe.h>
 #include <deal.II/fe/fe_q.h>
 #include <deal.II/fe/fe_system.h>
+#include <deal.II/fe/fe_values.h>
 // tools that allow to discribes the mapping of the deformation on the finite element probleme
 #include <deal.II/fe/mapping_q_eulerian.h>
 #include <deal.II/fe/mapping_fe_field.h>
+#include <deal.II/fe/mapping_q_generic.h>
 
 #include <deal.II/dofs/dof_tools.h>
+#include <deal.II/dofs/dof_renumbering.h>
 #include <deal.II/base/parsed_function.h>
+#include <deal.II/base/function_parser.h>
 #include <deal.II/numerics/data_out.h>
 #include <deal.II/numerics/vector_tools.h>
 #include <deal.II/numerics/matrix_tools.h>
@@ -35,6 +42,7 @@
 // other stuff as usual
 
 #include <deal.II/lac/sparse_matrix.h>
+#include <deal.II/lac/full_matrix.h>
 #include <deal.II/lac/vector.h>
 #include <deal.II/lac/sparse_direct.h>
 #include <deal.II/lac/solver_cg.h>
@@ -43,9 +51,31 @@
 #include <deal.II/lac/linear_operator_tools.h>
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <map>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <array>
+#include <limits>
+#include <sys/stat.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 #include <deal.II/numerics/vector_tools.h>
 #include <deal.II/numerics/error_estimator.h>
 #include <deal.II/grid/grid_refinement.h>
+// binary checkpoint of the mesh and the vectors
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/archive/binary_iarchive.hpp>
+
+#include "binary_results.h"
+#include "perf_counters.h"
+#include "compiled_expression.h"
+#include "banded_cholesky.h"
+#include "coupling_operator.h"
+#include "schur_operator.h"
+#include "sell_matrix.h"
 // make it possible to directly call dealII function
 
 
@@ -53,6 +83,283 @@
 //define class that would be call during the finite elements analysis
 namespace mystep60 {
     using namespace dealii;
+
+    // text of a Functions::ParsedFunction subsection, keep so the same expression can be rebuild whit other constants
+    struct FunctionDefinition {
+        std::string variables;
+        std::string expression;
+        std::map<std::string, double> constants;
+    };
+
+    // read a list of constants of the form "a=1, b=2" the same way Functions::ParsedFunction does
+    std::map<std::string, double> parse_constants(const std::string &constants_list) {
+        std::map<std::string, double> constants;
+        for (const auto &constant : Utilities::split_string_list(constants_list, ',')) {
+            const std::vector<std::string> this_c = Utilities::split_string_list(constant, '=');
+            AssertThrow(this_c.size() == 2,
+                        ExcMessage("The list of constants, <" + constants_list +
+                                   ">, is not a comma-separated list of entries of the form 'name=value'."));
+            constants[this_c[0]] = Utilities::string_to_double(this_c[1]);
+        }
+        return constants;
+    }
+
+    // must be call while the ParameterHandler is inside the subsection of the parsed function
+    FunctionDefinition read_function_definition(const ParameterHandler &prm) {
+        FunctionDefinition definition;
+        definition.variables = prm.get("Variable names");
+        definition.expression = prm.get("Function expression");
+        definition.constants = parse_constants(prm.get("Function constants"));
+        return definition;
+    }
+
+    // resident memory of the process in kB
+    std::size_t resident_memory() {
+        Utilities::System::MemoryStats memory_stats;
+        Utilities::System::get_memory_stats(memory_stats);
+        return memory_stats.VmRSS;
+    }
+
+    // bytes given by malloc and not freed yet ( blocks of all the arenas and mmap blocks) so the memory freed
+    // before and reused is not missed as whit the resident memory. It count the allocations of every thread of
+    // the process, the resident memory is used when the allocator does not tell it
+    std::size_t heap_in_use() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+        const struct mallinfo2 info = mallinfo2();
+        return info.uordblks + info.hblkhd;
+#else
+        return resident_memory() * 1024;
+#endif
+    }
+
+    // set the peak resident memory ( VmHWM) back to the current one, so the peak read after is the one of the
+    // work done since the call. Return false if the kernel does not allow it ( linux before 4.0, other OS)
+    bool reset_peak_memory() {
+        std::ofstream clear_refs("/proc/self/clear_refs");
+        clear_refs << "5" << std::endl;
+        return static_cast<bool>(clear_refs);
+    }
+
+    // constants of a definition, the constants given override the one of the definition
+    std::map<std::string, double> function_constants(const FunctionDefinition &definition,
+                                                     const std::map<std::string, double> &constants) {
+        std::map<std::string, double> all_constants = definition.constants;
+        for (const auto &constant : constants)
+            all_constants[constant.first] = constant.second;
+        // same default than ParsedFunction
+        all_constants["pi"] = numbers::PI;
+        all_constants["Pi"] = numbers::PI;
+        return all_constants;
+    }
+
+    // initialize a FunctionParser from a definition, the constants given override the one of the definition
+    template<int spacedim>
+    void initialize_function(FunctionParser<spacedim> &function, const FunctionDefinition &definition,
+                             const std::map<std::string, double> &constants) {
+        const std::map<std::string, double> all_constants = function_constants(definition, constants);
+        const unsigned int n_variables = Utilities::split_string_list(definition.variables, ',').size();
+        function.initialize(definition.variables, Utilities::split_string_list(definition.expression, ';'),
+                            all_constants, n_variables == spacedim + 1);
+    }
+
+    // same function than a FunctionParser of the definition, but the expressions are compiled once and the
+    // points of value_list and vector_value_list are evaluated in batch
+    template<int spacedim>
+    class CompiledFunction : public Function<spacedim> {
+    public:
+        // throw if one of the expressions can not be compiled
+        CompiledFunction(const FunctionDefinition &definition, const std::map<std::string, double> &constants)
+                : Function<spacedim>(Utilities::split_string_list(definition.expression, ';').size()) {
+            const std::vector<std::string> variables = Utilities::split_string_list(definition.variables, ',');
+            AssertThrow(variables.size() == spacedim || variables.size() == spacedim + 1,
+                        ExcMessage("The variables <" + definition.variables + "> do not match the dimension."));
+            const std::map<std::string, double> all_constants = function_constants(definition, constants);
+            for (const auto &expression : Utilities::split_string_list(definition.expression, ';'))
+                expressions.emplace_back(expression, variables, all_constants);
+        }
+
+        double value(const Point<spacedim> &p, const unsigned int component = 0) const override {
+            double result;
+            expressions[component].evaluate(coordinates({p}).second, 1, &result);
+            return result;
+        }
+
+        void vector_value(const Point<spacedim> &p, Vector<double> &values) const override {
+            const auto point_coordinates = coordinates({p});
+            for (unsigned int c = 0; c < expressions.size(); ++c)
+                expressions[c].evaluate(point_coordinates.second, 1, &values(c));
+        }
+
+        void value_list(const std::vector<Point<spacedim>> &points, std::vector<double> &values,
+                        const unsigned int component = 0) const override {
+            expressions[component].evaluate(coordinates(points).second, points.size(), values.data());
+        }
+
+        void vector_value_list(const std::vector<Point<spacedim>> &points,
+                               std::vector<Vector<double>> &values) const override {
+            const auto point_coordinates = coordinates(points);
+            std::vector<double> component_values(points.size());
+            for (unsigned int c = 0; c < expressions.size(); ++c) {
+                expressions[c].evaluate(point_coordinates.second, points.size(), component_values.data());
+                for (unsigned int i = 0; i < points.size(); ++i)
+                    values[i](c) = component_values[i];
+            }
+        }
+
+    private:
+        // one array per coordinate and one for the time, whit the pointers given to the expressions
+        std::pair<std::vector<std::vector<double>>, std::vector<const double *>>
+        coordinates(const std::vector<Point<spacedim>> &points) const {
+            std::pair<std::vector<std::vector<double>>, std::vector<const double *>> result;
+            result.first.assign(spacedim + 1, std::vector<double>(points.size(), this->get_time()));
+            for (unsigned int i = 0; i < points.size(); ++i)
+                for (unsigned int d = 0; d < spacedim; ++d)
+                    result.first[d][i] = points[i][d];
+            for (const auto &coordinate : result.first)
+                result.second.push_back(coordinate.data());
+            return result;
+        }
+
+        std::vector<CompiledExpression> expressions;
+    };
+
+    // compiled function when the expressions allow it, FunctionParser ( muparser) otherwise
+    template<int spacedim>
+    std::unique_ptr<Function<spacedim>> make_function(const FunctionDefinition &definition,
+                                                      const std::map<std::string, double> &constants,
+                                                      const bool compiled) {
+        if (compiled)
+            try {
+                return std_cxx14::make_unique<CompiledFunction<spacedim>>(definition, constants);
+            }
+            catch (std::exception &exc) {
+                deallog << exc.what() << ", muparser is used instead" << std::endl;
+            }
+        auto function = std_cxx14::make_unique<FunctionParser<spacedim>>(
+                Utilities::split_string_list(definition.expression, ';').size());
+        initialize_function(*function, definition, constants);
+        return std::move(function);
+    }
+
+    // radial solution for the circle of radius R centered at c: 1 inside and 1 + ln(r/R) outside. Both are
+    // harmonic in 2D, the jump of the normal derivative on the circle is 1/R so the exact lambda is -1/R
+    template<int spacedim>
+    class ManufacturedSolution : public Function<spacedim> {
+    public:
+        ManufacturedSolution(const Point<spacedim> &center, const double radius) : center(center), radius(radius) {}
+
+        double value(const Point<spacedim> &p, const unsigned int = 0) const override {
+            const double r = center.distance(p);
+            return r < radius ? 1. : 1. + std::log(r / radius);
+        }
+
+        // SIMD packs of points, the logarithm is only kept for the points outside the circle
+        void value_list(const std::vector<Point<spacedim>> &points, std::vector<double> &values,
+                        const unsigned int = 0) const override {
+            constexpr unsigned int n_lanes = VectorizedArray<double>::n_array_elements;
+            for (unsigned int begin = 0; begin < points.size(); begin += n_lanes) {
+                const unsigned int n = std::min<unsigned int>(n_lanes, points.size() - begin);
+                VectorizedArray<double> r_square, x;
+                r_square = 0.;
+                for (unsigned int d = 0; d < spacedim; ++d) {
+                    // the lanes after the last point are filled whit a point outside the circle
+                    x = center[d] + radius;
+                    for (unsigned int l = 0; l < n; ++l)
+                        x[l] = points[begin + l][d];
+                    x -= center[d];
+                    r_square += x * x;
+                }
+                const VectorizedArray<double> outside = 1. + 0.5 * std::log(r_square / (radius * radius));
+                for (unsigned int l = 0; l < n; ++l)
+                    values[begin + l] = (r_square[l] < radius * radius ? 1. : outside[l]);
+            }
+        }
+
+        Tensor<1, spacedim> gradient(const Point<spacedim> &p, const unsigned int = 0) const override {
+            const Tensor<1, spacedim> x = p - center;
+            if (x.norm_square() < radius * radius)
+                return Tensor<1, spacedim>();
+            return x / x.norm_square();
+        }
+
+        double lambda() const {
+            return -1. / radius;
+        }
+
+    private:
+        const Point<spacedim> center;
+        const double radius;
+    };
+
+    // positions, JxW and jacobians of the points of a quadrature on every active cell of the embedded mesh.
+    // The configuration does not change during the adaptive cycles, so the mapping is only evaluated the first
+    // time a quadrature is asked, the cache must be cleared when the configuration change
+    template<int dim, int spacedim>
+    class EmbeddedMappingCache {
+    public:
+        struct Data {
+            Quadrature<dim> quadrature;
+            // point q of the active cell c is at c*quadrature.size()+q
+            std::vector<Point<spacedim>> points;
+            std::vector<double> JxW;
+            std::vector<DerivativeForm<1, dim, spacedim>> jacobians;
+        };
+
+        const Data &get(const Mapping<dim, spacedim> &mapping, const DoFHandler<dim, spacedim> &dof_handler,
+                        const Quadrature<dim> &quadrature) {
+            for (const auto &data : cache)
+                if (data->quadrature == quadrature)
+                    return *data;
+
+            auto data = std_cxx14::make_unique<Data>();
+            data->quadrature = quadrature;
+            const std::size_t n_points = dof_handler.get_triangulation().n_active_cells() * quadrature.size();
+            data->points.reserve(n_points);
+            data->JxW.reserve(n_points);
+            data->jacobians.reserve(n_points);
+            FEValues<dim, spacedim> fe_values(mapping, dof_handler.get_fe(), quadrature,
+                                              update_quadrature_points | update_JxW_values | update_jacobians);
+            for (const auto &cell : dof_handler.active_cell_iterators()) {
+                fe_values.reinit(cell);
+                for (unsigned int q = 0; q < quadrature.size(); ++q) {
+                    data->points.push_back(fe_values.quadrature_point(q));
+                    data->JxW.push_back(fe_values.JxW(q));
+                    data->jacobians.push_back(fe_values.jacobian(q));
+                }
+            }
+            cache.push_back(std::move(data));
+            return *cache.back();
+        }
+
+        void clear() {
+            cache.clear();
+        }
+
+        std::size_t memory_consumption() const {
+            std::size_t bytes = 0;
+            for (const auto &data : cache)
+                bytes += data->points.capacity() * sizeof(Point<spacedim>) +
+                         data->JxW.capacity() * sizeof(double) +
+                         data->jacobians.capacity() * sizeof(DerivativeForm<1, dim, spacedim>);
+            return bytes;
+        }
+
+    private:
+        // the Data does not move so the references given by get() stay valid until clear()
+        std::vector<std::unique_ptr<Data>> cache;
+    };
+
+    // section of the monitor and of the hardware counters opened together under the same name
+    class SectionScope {
+    public:
+        SectionScope(TimerOutput &monitor, PerfCounters &counters, const std::string &section_name)
+                : timer_scope(monitor, section_name), counter_scope(counters, section_name) {}
+
+    private:
+        TimerOutput::Scope timer_scope;
+        PerfCounters::Scope counter_scope;
+    };
+
     template<int dim, int spacedim = dim>
     class DistributedLagrangeProblem {
         //Bonne pratique de limite les fonctions de types public et de regrouper le plus
@@ -62,7 +369,8 @@ namespace mystep60 {
         class Parameters : public ParameterAcceptor {
             //gonna recive all other parameter difined
         public:
-            Parameters();
+            // the instance name is only needed when many problems are parsed from the same ParameterHandler
+            Parameters(const std::string &instance_name = "");
 
             // define the number of time that the code is gonna refine the first mesh
             unsigned int initial_refinement=5;
@@ -78,7 +386,8 @@ namespace mystep60 {
             unsigned int domain_fe_deg = 1;
             // Deg of the space that is used to discribe the deformation of the embedded domain
             unsigned int deformation_fe_deg = 1;
-            //order of the quadrature formula
+            //order of the quadrature formula, the fused embedded assembly use at least 2*degree+1 ( the order
+            // of the rhs) because the same points are used for the coupling and the rhs
             unsigned int coupling_quadrature_order = 3;
 
             // const bool to define which intepretation is made from the deformation function ( displacement or delta)
@@ -87,6 +396,78 @@ namespace mystep60 {
             // level of verbosity  for  output data ( ????) present in the exemle code not sure what is it doing
             unsigned int verbosity_lvl = 10;
 
+            // number of solve ( at least one), the mesh is refine whit the Kelly estimator between each one
+            unsigned int n_cycles = 3;
+
+            // sets of constants ( separate by | ) for the embedded functions that are solve one after the other
+            // whitout rebuilding the embedding space, ex: "R=.3, Cx=.4 | R=.2, Cx=.5"
+            std::string sweep_constants = "";
+            // same thing but from a csv file, the first line give the name of the constants and each other line is a set
+            std::string sweep_constants_file = "";
+
+            // directory where all the results are written ( empty = current directory)
+            std::string output_directory = "";
+            // also write solution, lambda, g and the support points in the raw format of binary_results.h
+            bool write_binary_results = false;
+            // vtu ( one file per domain) or hdf5 ( one .h5 per domain and a single .xdmf for both)
+            std::string output_format = "vtu";
+            // zlib compression of the vtu files, best_compression is the default of deal.II
+            std::string output_compression = "best_compression";
+            // write the vtu files in the background while the computation continue
+            bool asynchronous_output = false;
+            // maximum number of output being written at the same time before output() wait for the oldest
+            unsigned int output_queue_length = 2;
+            // write embedding-NNNN.vtu and embedded-NNNN.vtu every n cycles ( and at the last one),
+            // 0 only write embedding.vtu and embedded.vtu at the end
+            unsigned int output_frequency = 0;
+            // all: every cell of the embedding mesh, band: only the cells arround the embedded domain
+            std::string output_cells = "all";
+            // width of the band in layers of cells arround the cells that contain the embedded support points
+            unsigned int output_band_layers = 2;
+            // number of vtu files the embedding mesh is split in ( whit a pvtu master file when more than one),
+            // the pieces are build and written in parallel
+            unsigned int output_pieces = 1;
+
+            // export the time of each section of the monitor for each cycle in statistics.json and/or statistics.csv
+            std::string statistics_format = "none";
+            // also count cycles, instructions, cache misses and branch misses in each section ( linux perf_event,
+            // ignored if the kernel does not allow it)
+            bool hardware_counters = false;
+
+            // file where the mesh, configuration, solution and lambda are saved after the adaptive cycles
+            std::string checkpoint_file = "";
+            // start from the checkpoint file instead of building the mesh and doing the adaptive cycles again
+            bool restart_from_checkpoint = false;
+            // also save the assembled stiffness matrix so the restart does not assemble it again
+            bool checkpoint_stiffness_matrix = false;
+
+            // replace the embedded value and the boundary values by the radial solution of the circle given
+            // by the constants R, Cx and Cy of the configuration, and compute the errors after each solve
+            bool manufactured_solution = false;
+
+            // when all the cells of the embedding mesh are axis-aligned cubes, copy the laplace matrix of one
+            // cell instead of doing the quadrature on each cell
+            bool reference_cell_matrix = true;
+            // build the coupling matrix, the rhs and the interpolation of the embedded value in a single loop
+            // over the embedded cells instead of three, whit the mapping of the embedded cells cached between
+            // the cycles ( the coupling quadrature order is raised to the one of the rhs)
+            bool fused_embedded_assembly = true;
+            // evaluate the expressions of the embedded configuration and value whit a compiled bytecode
+            // instead of muparser ( muparser is still used for the expressions the compiler does not know)
+            bool compiled_expressions = true;
+            // order of the embedding dofs before building the stiffness sparsity: none ( order of the cells),
+            // Cuthill_McKee, hierarchical ( space filling curve of the cells), king or minimum_degree
+            // ( fill-reducing orderings for the direct solver)
+            std::string embedding_renumbering = "none";
+            // order of the embedded dofs: none ( order of the cells) or arc ( along the curve, dim = 1 only)
+            std::string embedded_renumbering = "none";
+            // preconditioner of the CG on the schur complement: identity or banded ( cholesky of the band of
+            // the schur complement, usefull whit the arc renumbering of the embedded dofs)
+            std::string schur_preconditioner = "identity";
+            // half width of the band kept by the banded preconditioner, it cost 2*b+1 applications of the
+            // schur complement to build
+            unsigned int schur_preconditioner_bandwidth = 8;
+
             // flag is the probleme is initialized or not
             bool initialized = false;
 
@@ -94,8 +475,59 @@ namespace mystep60 {
 
         DistributedLagrangeProblem(const Parameters &parameters);
 
+        // the output still running in the background use the probleme, so wait for them
+        ~DistributedLagrangeProblem();
+
         void run();
 
+        // memory used by one of the big object of the probleme
+        struct MemoryEntry {
+            std::string object;
+            std::size_t bytes;
+            // the object grow whit the number of active cells of the embedding mesh
+            bool embedding_side;
+        };
+
+        // what happen during one stage of the run ( an adaptive cycle, the final output, the sweep ...)
+        struct StageStatistics {
+            std::string stage;
+            unsigned int n_active_cells;
+            types::global_dof_index n_dofs;
+            types::global_dof_index n_dofs_sub;
+            std::size_t stiffness_nnz;
+            std::size_t coupling_nnz;
+            unsigned int schur_iterations;
+            // peak resident memory of the process ( VmHWM) in kB, since the start of the run when the benchmark
+            // could reset it
+            std::size_t peak_memory;
+            std::vector<MemoryEntry> memory;
+            // memory of the objects predicted from the flagged cells before the stage, 0 when there is none
+            std::size_t predicted_memory;
+            // L2 and H1 semi-norm error of the solution and L2 error of lambda whit the manufactured solution
+            std::array<double, 3> errors;
+            // cpu time, wall time and number of calls of each section of the monitor during the stage
+            std::map<std::string, std::array<double, 3>> sections;
+        };
+
+        const std::vector<StageStatistics> &get_statistics() const;
+
+        // time of one call of a stage of the microbenchmark, whit the work done by the call when it has a meaning
+        // ( number of points evaluated ...)
+        struct StageTiming {
+            std::string stage;
+            double min_wall;
+            double mean_wall;
+            double work;
+            std::string work_unit;
+            // memory traffic of one call, 0 when it is not estimated
+            double bytes;
+        };
+
+        // time each stage of the pipeline alone on the initial grid, sell_sorting_window is the sigma of the
+        // SELL-C-sigma copy of the stiffness matrix
+        std::vector<StageTiming> microbenchmark(const unsigned int repetitions,
+                                                const unsigned int sell_sorting_window);
+
     private:
         // the obeject where the parameters are stored
         const Parameters &parameters;
@@ -104,23 +536,133 @@ namespace mystep60 {
 
         void setup_grid();
 
+        // finite element, dofs and mapping that describe the position of the embedded domain
+        void setup_configuration();
+
         void local_refine();
 
+        // estimate the memory of the objects after the refinement from the cells flagged in the mesh
+        void predict_memory();
+
+        // memory_consumption() of each object of the probleme in its current state
+        std::vector<MemoryEntry> memory_report() const;
+
+        // save the state reach after the adaptive cycles
+        void save_checkpoint();
+
+        // rebuild the state saved by save_checkpoint(), return true if the stiffness matrix was in it
+        bool load_checkpoint();
+
         void setup_matrix();
 
         void setup_matrix_sub();
 
+        // number the embedded dofs in the order they are met when walking along the curve
+        void renumber_embedded_dofs_along_curve();
+
         // define the matrix that make the coupling  of the two domain
         void coulpling_system();
 
         // creat the big coupled systeme matrix
         void define_probleme();
 
+        // laplace matrix of the embedding space
+        void assemble_stiffness_matrix();
+
+        // true if every active cell of the embedding mesh is an axis-aligned cube
+        bool is_cartesian_mesh() const;
+
+        // part of the probleme that depend on the position of the embedded domain, the sparsity of the matrix
+        // must contain the one of coupling_mass_sparsity()
+        void assemble_coupling_matrix(SparseMatrix<double> &matrix);
+
+        // sparsity of the coupling mass matrix whit the quadrature of the coupling order
+        void coupling_mass_sparsity(DynamicSparsityPattern &dsp) const;
+
+        // part of the probleme that only depend on the value impose on the embedded domain
+        void assemble_embedded_rhs(const Function<spacedim> &value_function);
+
+        // the two above in one pass: the mapping of each embedded cell is evaluated once for the points of
+        // the coupling, of the rhs and of the interpolation
+        void assemble_embedded_system(const Function<spacedim> &value_function);
+
+        // coupling, rhs and interpolation whit the fused or the separate assembly
+        void assemble_embedded_problem(const Function<spacedim> &value_function);
+
+        // quadrature of the fused assembly, used for the rhs and the coupling: the coupling order raised to the
+        // order of the rhs when it is lower
+        QGauss<dim> embedded_quadrature() const;
+
+        // position of the support points of the embedded dofs, from the mapping cache
+        std::vector<Point<spacedim>> embedded_support_points() const;
+
 
         void solve();
         void solve_direct();
 
-        void output();
+        // build the radial solution from the constants of the configuration
+        void setup_manufactured_solution();
+
+        // functions evaluated for the configuration and the embedded value, from the parsed definitions
+        void setup_functions();
+
+        // interpolation of the configuration whit one batch of support points per component
+        void interpolate_configuration(const Function<spacedim> &function);
+
+        // error of the current solution and lambda whit the manufactured solution
+        std::array<double, 3> compute_errors() const;
+
+        // error of each cycle against the time spend since the start of the run
+        void print_errors() const;
+
+        // factorize the stiffness matrix if it changed since the last solve
+        void factorize_stiffness_matrix();
+
+        // probe and factorize the band of the schur complement if K or C changed since the last solve,
+        // return false if the band is not positive definite
+        bool setup_schur_preconditioner(const LinearOperator<Vector<double>> &S);
+
+        // when cycle is given the files are also added to the pvd time series
+        void output(const std::string &suffix = "", const int cycle = -1);
+
+        // dump of the results that can be mmap by the post-processing ( see binary_results.h)
+        void output_binary(const std::string &suffix) const;
+
+        // write the patches of the two domain in the chosen format, return the name of the files written
+        std::vector<std::string> write_vtu(const std::vector<std::shared_ptr<DataOut<spacedim>>> &embedding_out,
+                                           DataOut<dim, DoFHandler<dim, spacedim>> &embedded_out,
+                                           const std::string &suffix) const;
+
+        std::vector<std::string> write_hdf5(DataOut<spacedim> &embedding_out,
+                                            DataOut<dim, DoFHandler<dim, spacedim>> &embedded_out,
+                                            const std::string &suffix) const;
+
+        // flag the active cells of the embedding mesh that are at most n_layers cells away from the embedded domain
+        std::vector<bool> interface_band(const unsigned int n_layers) const;
+
+        // print the size of the files written by an output
+        void report_output(const std::vector<std::string> &files, const double wall_time) const;
+
+        // block until all the background output are written
+        void wait_for_output();
+
+        // add the files of one cycle to embedding.pvd and embedded.pvd, they are rewritten each time
+        // so paraview can follow a run that is not finish
+        void add_pvd_record(const int cycle, const std::string &suffix, const std::string &embedding_extension);
+
+        // keep the time spend in each section of the monitor since the last call and the size of the probleme
+        void record_statistics(const std::string &stage);
+
+        // write all the recorded statistics in the format asked in the parameters
+        void export_statistics() const;
+
+        // solve again for each set of constants of the sweep whit the same embedding space
+        void run_sweep();
+
+        std::vector<std::map<std::string, double>> read_sweep_variants() const;
+
+        // path of a result file in the output directory of this instance
+        std::string output_file(const std::string &name) const;
 
         //define global variables of the domain
 
@@ -146,9 +688,25 @@ namespace mystep60 {
         // use the Function Parsed Function to replace the communl;y user defined function for the right hand side of the equat
         ParameterAcceptorProxy<Functions::ParsedFunction<spacedim>> configuration_function;
         std::unique_ptr<Mapping<dim, spacedim>> sub_domain_mapping;
+        // filled on demand by the operations on the embedded mesh, even the const ones
+        mutable EmbeddedMappingCache<dim, spacedim> embedded_mapping_cache;
+        // dofs of each active embedded cell, cell c has dofs c*dofs_per_cell ... (c+1)*dofs_per_cell-1
+        std::vector<types::global_dof_index> embedded_cell_dofs;
+        // embedding cells that contain the points of embedded_quadrature(), found when the coupling sparsity
+        // is build and used again by the assembly
+        std::tuple<std::vector<typename Triangulation<spacedim>::active_cell_iterator>,
+                std::vector<std::vector<Point<spacedim>>>, std::vector<std::vector<unsigned int>>>
+                embedded_point_locations;
 
         ParameterAcceptorProxy<Functions::ParsedFunction<spacedim>> sub_domain_value_function;
 
+        // copy of the text of the two parsed function, needed to change there constants during a sweep
+        FunctionDefinition configuration_definition;
+        FunctionDefinition sub_domain_value_definition;
+        // the two functions actually evaluated, compiled or muparser
+        std::unique_ptr<Function<spacedim>> configuration_evaluator;
+        std::unique_ptr<Function<spacedim>> sub_domain_value_evaluator;
+
         // do the same whit REduction class let specificy solver control criteria
         ParameterAcceptorProxy<ReductionControl> schur_solver_control;
 
@@ -159,11 +717,30 @@ namespace mystep60 {
         SparseMatrix<double> stiffnes_matrix;
         SparseMatrix<double> coupling_matrix;
         SparseMatrix<double> global_matrix;
-        SparseMatrix<double> coupling_transpose;
+        // products whit coupling_matrix and its transpose, on the values of coupling_matrix
+        CouplingOperator coupling_operator;
+        // C K^-1 Ct in one product whit its own work vector
+        SchurOperator schur_operator;
 
         // make possible to have hanging not and pass boundary condition on it
         AffineConstraints<double> constraints;
 
+        // factorization of the stiffness matrix, keep as long as the embedding space does not change
+        SparseDirectUMFPACK K_inv_umfpack;
+        bool K_factorized = false;
+        // UMFPACK does not tell the size of its factors, so it is the growth of the heap in use during the
+        // factorization ( approximate: the other threads of a batch allocate at the same time)
+        std::size_t K_inv_memory = 0;
+        // factor of the band of the schur complement, keep as long as K and C does not change
+        BandedCholesky schur_preconditioner;
+        bool schur_preconditioner_ready = false;
+        // memory predicted by the last local_refine()
+        std::size_t predicted_memory = 0;
+
+        // exact solution, only when the manufactured solution is asked
+        std::unique_ptr<ManufacturedSolution<spacedim>> manufactured_solution;
+        std::array<double, 3> errors{{0., 0., 0.}};
+
         // vector used in the evaluation of the function
         Vector<double> solution;
         Vector<double> rhs;
@@ -173,13 +750,28 @@ namespace mystep60 {
 
         // provide stats of the resolution
         TimerOutput monitor;
+        // hardware counters of the same sections, only open when asked in the parameters
+        PerfCounters counters;
+
+        // output being written in the background, the oldest first
+        std::deque<Threads::Task<void>> output_tasks;
+
+        std::vector<StageStatistics> statistics;
+        // total of the monitor at the last record, the monitor only give the time since the start
+        std::map<std::string, std::array<double, 3>> recorded_sections;
+
+        // time series of the output of each cycle, protected since the background output add to them
+        std::vector<std::pair<double, std::string>> embedding_pvd_records;
+        std::vector<std::pair<double, std::string>> embedded_pvd_records;
+        std::mutex pvd_mutex;
 
     };
 
 // define the parameter file
     template<int dim, int spacedim>
-    DistributedLagrangeProblem<dim, spacedim>::Parameters::Parameters():
-            ParameterAcceptor("/Distributed Lagrange<" +
+    DistributedLagrangeProblem<dim, spacedim>::Parameters::Parameters(const std::string &instance_name):
+            ParameterAcceptor("/" + (instance_name.empty() ? "" : instance_name + "/") +
+                              "Distributed Lagrange<" +
                               Utilities::int_to_string(dim) + "," +
                               Utilities::int_to_string(spacedim) + ">/") {
 
@@ -197,8 +789,45 @@ namespace mystep60 {
                       embedded_fe_deg);
         add_parameter("Embedded configuration finite element degree",
                       deformation_fe_deg);
-        add_parameter("Coupling quadrature order", coupling_quadrature_order);
+        add_parameter("Coupling quadrature order", coupling_quadrature_order,
+                      "Order of the gauss quadrature of the coupling matrix. When \"Fused embedded assembly\" "
+                      "is true the coupling and the rhs share one quadrature of order "
+                      "max(this order, 2*embedded degree+1), so a lower order is raised.");
         add_parameter("Verbosity level", verbosity_lvl);
+        add_parameter("Number of adaptive cycles", n_cycles, "", this->prm, Patterns::Integer(1));
+        add_parameter("Sweep constants", sweep_constants);
+        add_parameter("Sweep constants file", sweep_constants_file);
+        add_parameter("Output directory", output_directory);
+        add_parameter("Write binary results", write_binary_results);
+        add_parameter("Output format", output_format, "", this->prm, Patterns::Selection("vtu|hdf5"));
+        add_parameter("Output compression level", output_compression, "", this->prm,
+                      Patterns::Selection("no_compression|best_speed|best_compression|default_compression"));
+        add_parameter("Asynchronous output", asynchronous_output);
+        add_parameter("Output queue length", output_queue_length);
+        add_parameter("Output frequency", output_frequency);
+        add_parameter("Output cells", output_cells, "", this->prm, Patterns::Selection("all|band"));
+        add_parameter("Output band layers", output_band_layers);
+        add_parameter("Output pieces", output_pieces);
+        add_parameter("Statistics format", statistics_format, "", this->prm,
+                      Patterns::Selection("none|json|csv|json and csv"));
+        add_parameter("Hardware counters", hardware_counters);
+        add_parameter("Checkpoint file", checkpoint_file);
+        add_parameter("Restart from checkpoint", restart_from_checkpoint);
+        add_parameter("Checkpoint stiffness matrix", checkpoint_stiffness_matrix);
+        add_parameter("Manufactured solution", manufactured_solution);
+        add_parameter("Reference cell laplace matrix", reference_cell_matrix);
+        add_parameter("Fused embedded assembly", fused_embedded_assembly,
+                      "Assemble the coupling, the rhs and the interpolation in one loop. The coupling then use "
+                      "the quadrature of the rhs when \"Coupling quadrature order\" is lower than "
+                      "2*embedded degree+1, so its matrix differ from the one of the separate assembly.");
+        add_parameter("Compiled expressions", compiled_expressions);
+        add_parameter("Embedding dof renumbering", embedding_renumbering, "", this->prm,
+                      Patterns::Selection("none|Cuthill_McKee|hierarchical|king|minimum_degree"));
+        add_parameter("Embedded dof renumbering", embedded_renumbering, "", this->prm,
+                      Patterns::Selection("none|arc"));
+        add_parameter("Schur preconditioner", schur_preconditioner, "", this->prm,
+                      Patterns::Selection("identity|banded"));
+        add_parameter("Schur preconditioner bandwidth", schur_preconditioner_bandwidth);
 
 
         parse_parameters_call_back.connect([&]() -> void { initialized = true; });
@@ -220,6 +849,12 @@ namespace mystep60 {
         // Define the sub domain value function to a csontant
         sub_domain_value_function.declare_parameters_call_back.connect([]() -> void {
             ParameterAcceptor::prm.set("Function expression", "1"); });
+
+        // keep the text of the functions when they are parsed
+        configuration_function.parse_parameters_call_back.connect([&]() -> void {
+            configuration_definition = read_function_definition(ParameterAcceptor::prm); });
+        sub_domain_value_function.parse_parameters_call_back.connect([&]() -> void {
+            sub_domain_value_definition = read_function_definition(ParameterAcceptor::prm); });
         // define parameters of the solver
 
         schur_solver_control.declare_parameters_call_back.connect([]() -> void {
@@ -230,6 +865,11 @@ namespace mystep60 {
 
     }
 
+    template<int dim, int spacedim>
+    DistributedLagrangeProblem<dim, spacedim>::~DistributedLagrangeProblem() {
+        wait_for_output();
+    }
+
     template<int dim, int spacedim>
     void DistributedLagrangeProblem<dim, spacedim>::local_refine()
     {
@@ -239,16 +879,66 @@ namespace mystep60 {
                                            std::map<types::boundary_id,const Function <spacedim> *>(),solution,estimated_error_per_cell);
 
         GridRefinement::refine_and_coarsen_fixed_number(*mesh,estimated_error_per_cell,0.3,0.03);
+        // smooth the flags now so the prediction count the cells that really change
+        mesh->prepare_coarsening_and_refinement();
+        predict_memory();
         mesh->execute_coarsening_and_refinement();
         setup_matrix();
 
     }
 
+    template<int dim, int spacedim>
+    void DistributedLagrangeProblem<dim, spacedim>::predict_memory() {
+        unsigned int n_refined = 0, n_coarsened = 0;
+        for (const auto &cell : mesh->active_cell_iterators())
+            if (cell->refine_flag_set())
+                ++n_refined;
+            else if (cell->coarsen_flag_set())
+                ++n_coarsened;
+
+        // a refined cell give its children, the coarsened cells are merged by group of children
+        const double n_children = GeometryInfo<spacedim>::max_children_per_cell;
+        const double n_predicted_cells = mesh->n_active_cells() + n_refined * (n_children - 1) -
+                                         n_coarsened * (n_children - 1) / n_children;
+        const double ratio = n_predicted_cells / mesh->n_active_cells();
+
+        // linear in the number of cells, the fill-in of the factorization grow a bit faster
+        double predicted = 0;
+        for (const auto &entry : memory_report())
+            predicted += (entry.embedding_side ? ratio : 1.) * entry.bytes;
+        predicted_memory = static_cast<std::size_t>(predicted);
+
+        deallog << "Flagged cells: " << n_refined << " to refine, " << n_coarsened
+                << " to coarsen, predicted active cells: " << static_cast<unsigned int>(n_predicted_cells)
+                << ", predicted memory: " << predicted / 1048576. << " MB" << std::endl;
+    }
+
+    template<int dim, int spacedim>
+    std::vector<typename DistributedLagrangeProblem<dim, spacedim>::MemoryEntry>
+    DistributedLagrangeProblem<dim, spacedim>::memory_report() const {
+        return {{"mesh", mesh->memory_consumption(), true},
+                {"dof_handler", dof_handler->memory_consumption(), true},
+                {"stiffness_sparsity", stiffness_sparsity.memory_consumption(), true},
+                {"stiffnes_matrix", stiffnes_matrix.memory_consumption(), true},
+                {"K_inv_umfpack (approx. heap growth)", K_inv_memory, true},
+                {"coupling_sparsity", coupling_sparsity.memory_consumption(), true},
+                {"coupling_matrix", coupling_matrix.memory_consumption(), true},
+                {"coupling_operator", coupling_operator.memory_consumption(), true},
+                {"schur_operator", schur_operator.memory_consumption(), true},
+                {"embedding vectors", solution.memory_consumption() + rhs.memory_consumption(), true},
+                {"mesh_sub", mesh_sub->memory_consumption(), false},
+                {"dof_handler_sub", dof_handler_sub->memory_consumption(), false},
+                {"embedded mapping cache", embedded_mapping_cache.memory_consumption(), false},
+                {"embedded vectors", lambda.memory_consumption() + sub_domain_rhs.memory_consumption() +
+                                     sub_domain_value.memory_consumption() + configuration.memory_consumption(),
+                 false}};
+    }
+
 // setting up the mesh for the system
     template<int dim, int spacedim>
     void DistributedLagrangeProblem<dim, spacedim>::setup_grid() {
         //output the time of the
-        TimerOutput::Scope timer_section(monitor, "setup grids and dofs");
+        const SectionScope timer_section(monitor, counters, "setup grids and dofs");
         // generate basic mesh
         mesh = std_cxx14::make_unique<Triangulation<spacedim>>();
         GridGenerator::hyper_cube(*mesh, 0, 1, true);
@@ -260,33 +950,19 @@ namespace mystep60 {
         GridGenerator::hyper_cube(*mesh_sub);
         mesh_sub->refine_global(parameters.initial_embedded_grid_refinement);
 
-        // generate the finite element sub domain information
-        configuration_FE = std_cxx14::make_unique<FESystem<dim, spacedim>>(
-                FE_Q<dim, spacedim>(parameters.embedded_fe_deg), spacedim);
-        configuration_dof_handler = std_cxx14::make_unique<DoFHandler<dim, spacedim>>(*mesh_sub);
-        configuration_dof_handler->distribute_dofs(*configuration_FE);
-        configuration.reinit(configuration_dof_handler->n_dofs());
+        setup_configuration();
 
         // interpolate the configuration and deformation of the domain
-        VectorTools::interpolate(*configuration_dof_handler, configuration_function, configuration);
-
-        //mapping the deformation of the sub domain to the subdomain
-        if (parameters.use_displacement == true)
-            sub_domain_mapping = std_cxx14::make_unique<MappingQEulerian<dim, Vector<double>, spacedim>>(
-                    parameters.deformation_fe_deg, *configuration_dof_handler, configuration
-            );
-        else
-            sub_domain_mapping = std_cxx14::make_unique<MappingFEField<dim, spacedim, Vector<double>, DoFHandler<
-                    dim, spacedim>>>(*configuration_dof_handler, configuration);
+        interpolate_configuration(*configuration_evaluator);
 
         // set it up on the sub matrix domain
         setup_matrix_sub();
 
 
         //define the support point of the sub domain so we can refine arrond it in a later operation
-        std::vector<Point<spacedim>> support_point(dof_handler_sub->n_dofs());
+        std::vector<Point<spacedim>> support_point;
         if (parameters.delta_refinement != 0)
-            DoFTools::map_dofs_to_support_points(*sub_domain_mapping, *dof_handler_sub, support_point);
+            support_point = embedded_support_points();
 
         // set flag for refinement arrond the points that support the sub domain and there neigboring cell
         for (unsigned int i = 0; i < parameters.delta_refinement; i++) {
@@ -331,17 +1007,130 @@ namespace mystep60 {
     }
 
 
+    template<int dim, int spacedim>
+    void DistributedLagrangeProblem<dim, spacedim>::setup_configuration() {
+        // generate the finite element sub domain information
+        configuration_FE = std_cxx14::make_unique<FESystem<dim, spacedim>>(
+                FE_Q<dim, spacedim>(parameters.embedded_fe_deg), spacedim);
+        configuration_dof_handler = std_cxx14::make_unique<DoFHandler<dim, spacedim>>(*mesh_sub);
+        configuration_dof_handler->distribute_dofs(*configuration_FE);
+        configuration.reinit(configuration_dof_handler->n_dofs());
+        embedded_mapping_cache.clear();
+
+        //mapping the deformation of the sub domain to the subdomain ( the mapping only keep a reference to configuration)
+        if (parameters.use_displacement == true)
+            sub_domain_mapping = std_cxx14::make_unique<MappingQEulerian<dim, Vector<double>, spacedim>>(
+                    parameters.deformation_fe_deg, *configuration_dof_handler, configuration
+            );
+        else
+            sub_domain_mapping = std_cxx14::make_unique<MappingFEField<dim, spacedim, Vector<double>, DoFHandler<
+                    dim, spacedim>>>(*configuration_dof_handler, configuration);
+    }
+
+    template<int dim, int spacedim>
+    void DistributedLagrangeProblem<dim, spacedim>::save_checkpoint() {
+        const SectionScope timer_section(monitor, counters, "Checkpoint");
+
+        std::ofstream file(parameters.checkpoint_file, std::ios::binary);
+        AssertThrow(file, ExcFileNotOpen(parameters.checkpoint_file));
+        boost::archive::binary_oarchive archive(file);
+
+        // the dofs are not saved, they are distributed again the same way on the loaded mesh
+        // so the degree and the renumbering must be the same to read back the vectors
+        unsigned int domain_fe_deg = parameters.domain_fe_deg;
+        unsigned int embedded_fe_deg = parameters.embedded_fe_deg;
+        std::string embedding_renumbering = parameters.embedding_renumbering;
+        std::string embedded_renumbering = parameters.embedded_renumbering;
+        archive << domain_fe_deg << embedded_fe_deg << embedding_renumbering << embedded_renumbering;
+
+        // the triangulation keep all its levels so the refinement history is saved whit it
+        archive << *mesh << *mesh_sub;
+        archive << configuration << solution << lambda;
+
+        bool has_stiffness_matrix = parameters.checkpoint_stiffness_matrix;
+        archive << has_stiffness_matrix;
+        if (has_stiffness_matrix) {
+            std::ofstream matrix_file(parameters.checkpoint_file + ".stiffness", std::ios::binary);
+            AssertThrow(matrix_file, ExcFileNotOpen(parameters.checkpoint_file + ".stiffness"));
+            stiffness_sparsity.block_write(matrix_file);
+            stiffnes_matrix.block_write(matrix_file);
+        }
+        deallog << "Checkpoint written in " << parameters.checkpoint_file << std::endl;
+    }
+
+    template<int dim, int spacedim>
+    bool DistributedLagrangeProblem<dim, spacedim>::load_checkpoint() {
+        const SectionScope timer_section(monitor, counters, "setup grids and dofs");
+
+        std::ifstream file(parameters.checkpoint_file, std::ios::binary);
+        AssertThrow(file, ExcFileNotOpen(parameters.checkpoint_file));
+        boost::archive::binary_iarchive archive(file);
+
+        unsigned int domain_fe_deg, embedded_fe_deg;
+        std::string embedding_renumbering, embedded_renumbering;
+        archive >> domain_fe_deg >> embedded_fe_deg >> embedding_renumbering >> embedded_renumbering;
+        AssertThrow(domain_fe_deg == parameters.domain_fe_deg && embedded_fe_deg == parameters.embedded_fe_deg,
+                    ExcMessage("The checkpoint " + parameters.checkpoint_file +
+                               " was written whit other finite element degrees."));
+        AssertThrow(embedding_renumbering == parameters.embedding_renumbering,
+                    ExcMessage("The checkpoint " + parameters.checkpoint_file +
+                               " was written whit the embedding dof renumbering " + embedding_renumbering + "."));
+        AssertThrow(embedded_renumbering == parameters.embedded_renumbering,
+                    ExcMessage("The checkpoint " + parameters.checkpoint_file +
+                               " was written whit the embedded dof renumbering " + embedded_renumbering + "."));
+
+        mesh = std_cxx14::make_unique<Triangulation<spacedim>>();
+        mesh_sub = std_cxx14::make_unique<Triangulation<dim, spacedim>>();
+        archive >> *mesh >> *mesh_sub;
+        mesh_tools = std_cxx14::make_unique<GridTools::Cache<spacedim, spacedim>>(*mesh);
+
+        // the configuration come from the checkpoint and not from the parameter file
+        setup_configuration();
+        archive >> configuration;
+        embedded_mapping_cache.clear();
+        setup_matrix_sub();
+        setup_matrix();
+        archive >> solution >> lambda;
+
+        bool has_stiffness_matrix;
+        archive >> has_stiffness_matrix;
+        if (has_stiffness_matrix) {
+            std::ifstream matrix_file(parameters.checkpoint_file + ".stiffness", std::ios::binary);
+            AssertThrow(matrix_file, ExcFileNotOpen(parameters.checkpoint_file + ".stiffness"));
+            stiffness_sparsity.block_read(matrix_file);
+            stiffnes_matrix.reinit(stiffness_sparsity);
+            stiffnes_matrix.block_read(matrix_file);
+        }
+        deallog << "Restart from " << parameters.checkpoint_file << ", Embedding Dofs: " << dof_handler->n_dofs()
+                << std::endl;
+        return has_stiffness_matrix;
+    }
+
     template<int dim, int spacedim>
     void DistributedLagrangeProblem<dim, spacedim>::setup_matrix() {
         //standards stuff for fe and dofs
         dof_handler = std_cxx14::make_unique<DoFHandler<spacedim>>(*mesh);
         fe = std_cxx14::make_unique<FE_Q<spacedim>>(parameters.domain_fe_deg);
         dof_handler->distribute_dofs(*fe);
+        // the default order follow the cells, the columns of a row of the stiffness matrix can be far apart
+        if (parameters.embedding_renumbering == "Cuthill_McKee")
+            DoFRenumbering::Cuthill_McKee(*dof_handler);
+        else if (parameters.embedding_renumbering == "hierarchical")
+            DoFRenumbering::hierarchical(*dof_handler);
+        else if (parameters.embedding_renumbering == "king")
+            DoFRenumbering::boost::king_ordering(*dof_handler);
+        else if (parameters.embedding_renumbering == "minimum_degree")
+            DoFRenumbering::boost::minimum_degree(*dof_handler);
         constraints.clear();
         // generate constraint element for the nodes and the boundary condition
         DoFTools::make_hanging_node_constraints(*dof_handler, constraints);
+        // the manufactured solution is not zero on the boundary
+        const Functions::ZeroFunction<spacedim> zero_function;
+        const Function<spacedim> &boundary_function =
+                (manufactured_solution ? static_cast<const Function<spacedim> &>(*manufactured_solution)
+                                       : zero_function);
         for (auto id : parameters.homogeneous_dirichlet_ids) {
-            VectorTools::interpolate_boundary_values(*dof_handler, id, Functions::ZeroFunction<spacedim>(), constraints);
+            VectorTools::interpolate_boundary_values(*dof_handler, id, boundary_function, constraints);
         }
         constraints.close();
 
@@ -351,6 +1140,9 @@ namespace mystep60 {
         DoFTools::make_sparsity_pattern(*dof_handler, dsp, constraints);
         stiffness_sparsity.copy_from(dsp);
         stiffnes_matrix.reinit(stiffness_sparsity);
+        K_factorized = false;
+        K_inv_memory = 0;
+        schur_preconditioner_ready = false;
         solution.reinit(dof_handler->n_dofs());
         rhs.reinit(dof_handler->n_dofs());
         deallog << "Embedding Dofs: " << dof_handler->n_dofs() << std::endl;
@@ -363,6 +1155,15 @@ namespace mystep60 {
         dof_handler_sub = std_cxx14::make_unique<DoFHandler<dim, spacedim>> (*mesh_sub);
         fe_sub = std_cxx14::make_unique<FE_Q<dim, spacedim>>  (parameters.embedded_fe_deg);
         dof_handler_sub->distribute_dofs(*fe_sub);
+        if (parameters.embedded_renumbering == "arc")
+            renumber_embedded_dofs_along_curve();
+        embedded_cell_dofs.resize(mesh_sub->n_active_cells() * fe_sub->dofs_per_cell);
+        std::vector<types::global_dof_index> local_dofs(fe_sub->dofs_per_cell);
+        for (const auto &cell : dof_handler_sub->active_cell_iterators()) {
+            cell->get_dof_indices(local_dofs);
+            std::copy(local_dofs.begin(), local_dofs.end(),
+                      embedded_cell_dofs.begin() + cell->active_cell_index() * fe_sub->dofs_per_cell);
+        }
 
         // define the value of the sub domaine
 
@@ -375,96 +1176,407 @@ namespace mystep60 {
 
     }
 
+    template<int dim, int spacedim>
+    void DistributedLagrangeProblem<dim, spacedim>::renumber_embedded_dofs_along_curve() {
+        AssertThrow(dim == 1, ExcMessage("The embedded dofs can only be numbered along the curve when dim = 1."));
+        // a vertex inside the curve has two cells, the ends of an open curve only one
+        const auto vertex_to_cells = GridTools::vertex_to_cell_map(*mesh_sub);
+
+        // one walk per piece of curve, an open one start from one of its end
+        std::vector<std::pair<typename Triangulation<dim, spacedim>::active_cell_iterator, unsigned int>> starts;
+        for (const auto &cell : mesh_sub->active_cell_iterators())
+            for (unsigned int v = 0; v < 2; ++v)
+                if (vertex_to_cells[cell->vertex_index(v)].size() == 1)
+                    starts.emplace_back(cell, v);
+        for (const auto &cell : mesh_sub->active_cell_iterators())
+            starts.emplace_back(cell, 0);
+
+        std::vector<types::global_dof_index> new_numbers(dof_handler_sub->n_dofs(), numbers::invalid_dof_index);
+        types::global_dof_index next_number = 0;
+        const auto number = [&](const types::global_dof_index dof) {
+            if (new_numbers[dof] == numbers::invalid_dof_index)
+                new_numbers[dof] = next_number++;
+        };
+        std::vector<bool> visited(mesh_sub->n_active_cells(), false);
+        std::vector<types::global_dof_index> local_dofs(fe_sub->dofs_per_cell);
+        const unsigned int n_interior_dofs = fe_sub->dofs_per_cell - 2;
+        for (auto start : starts) {
+            auto cell = start.first;
+            unsigned int entry = start.second;
+            while (!visited[cell->active_cell_index()]) {
+                visited[cell->active_cell_index()] = true;
+                const typename DoFHandler<dim, spacedim>::active_cell_iterator dof_cell(
+                        &*mesh_sub, cell->level(), cell->index(), dof_handler_sub.get());
+                dof_cell->get_dof_indices(local_dofs);
+                // FE_Q on a line: the dofs of the two vertices then the interior ones from the vertex 0 to the 1
+                number(local_dofs[entry]);
+                for (unsigned int k = 0; k < n_interior_dofs; ++k)
+                    number(local_dofs[2 + (entry == 0 ? k : n_interior_dofs - 1 - k)]);
+                number(local_dofs[1 - entry]);
+
+                // go on whit the other cell of the exit vertex, stop at the end of an open curve
+                const unsigned int exit_vertex = cell->vertex_index(1 - entry);
+                for (const auto &neighbor : vertex_to_cells[exit_vertex])
+                    if (neighbor != cell) {
+                        entry = (neighbor->vertex_index(0) == exit_vertex ? 0 : 1);
+                        cell = neighbor;
+                        break;
+                    }
+            }
+        }
+        dof_handler_sub->renumber_dofs(new_numbers);
+    }
+
     template<int dim, int spacedim>
     void DistributedLagrangeProblem<dim, spacedim>::coulpling_system() {
         // define the assembling og the two subdomain
-        TimerOutput::Scope timer_section(monitor, "Setup coupling");
+        const SectionScope timer_section(monitor, counters, "Setup coupling");
 
-        QGauss<dim> quad(parameters.coupling_quadrature_order);
         DynamicSparsityPattern dsp(dof_handler->n_dofs(), dof_handler_sub->n_dofs());
 
-        //match the two grid value  whit the systeme containe in a single object
-        NonMatching::create_coupling_sparsity_pattern(*mesh_tools, *dof_handler, *dof_handler_sub, quad, dsp,
-                                                      AffineConstraints<double>(), ComponentMask(), ComponentMask(),
-                                                      *sub_domain_mapping);
+        if (parameters.fused_embedded_assembly) {
+            // the same points than assemble_embedded_system() so the entries of the two always match
+            const QGauss<dim> fused_quad = embedded_quadrature();
+            const auto &data = embedded_mapping_cache.get(*sub_domain_mapping, *dof_handler_sub, fused_quad);
+            embedded_point_locations = GridTools::compute_point_locations(*mesh_tools, data.points);
+            const auto &cells = std::get<0>(embedded_point_locations);
+            const auto &maps = std::get<2>(embedded_point_locations);
+
+            const unsigned int dofs_per_cell_sub = fe_sub->dofs_per_cell;
+            std::vector<types::global_dof_index> local_dofs(fe->dofs_per_cell);
+            for (unsigned int c = 0; c < cells.size(); ++c) {
+                const typename DoFHandler<spacedim>::active_cell_iterator cell(&*mesh, cells[c]->level(),
+                                                                               cells[c]->index(), dof_handler.get());
+                cell->get_dof_indices(local_dofs);
+                unsigned int current_cell_sub = numbers::invalid_unsigned_int;
+                for (const unsigned int point : maps[c])
+                    if (point / fused_quad.size() != current_cell_sub) {
+                        current_cell_sub = point / fused_quad.size();
+                        for (const auto row : local_dofs)
+                            dsp.add_entries(row, embedded_cell_dofs.begin() + current_cell_sub * dofs_per_cell_sub,
+                                            embedded_cell_dofs.begin() + (current_cell_sub + 1) * dofs_per_cell_sub);
+                    }
+            }
+        } else
+            coupling_mass_sparsity(dsp);
 
         coupling_sparsity.copy_from(dsp);
         coupling_matrix.reinit(coupling_sparsity);
+        coupling_operator.reinit(coupling_matrix);
+        schur_preconditioner_ready = false;
     }
 
 
     template<int dim, int spacedim>
     void DistributedLagrangeProblem<dim, spacedim>::define_probleme() {
-        {//Assemble the matrix and the right hand side whit fancy function contrary to the usual loop
-            TimerOutput::Scope timer_section(monitor, "Assemble System");
-            MatrixTools::create_laplace_matrix(*dof_handler, QGauss<spacedim>(2 * fe->degree + 1), stiffnes_matrix,
-                                               static_cast<const Function<spacedim> *>(nullptr), constraints);
+        assemble_stiffness_matrix();
+        if (manufactured_solution)
+            assemble_embedded_problem(*manufactured_solution);
+        else
+            assemble_embedded_problem(*sub_domain_value_evaluator);
+    }
 
-            VectorTools::create_right_hand_side(*sub_domain_mapping, *dof_handler_sub,
-                                                QGauss<dim>(2 * fe_sub->degree + 1), sub_domain_value_function, sub_domain_rhs);
+    template<int dim, int spacedim>
+    void DistributedLagrangeProblem<dim, spacedim>::assemble_embedded_problem(const Function<spacedim> &value_function) {
+        // the coupling sparsity was build for the quadrature of the chosen assembly
+        if (parameters.fused_embedded_assembly)
+            assemble_embedded_system(value_function);
+        else {
+            assemble_coupling_matrix(coupling_matrix);
+            assemble_embedded_rhs(value_function);
+        }
+    }
 
+    template<int dim, int spacedim>
+    QGauss<dim> DistributedLagrangeProblem<dim, spacedim>::embedded_quadrature() const {
+        return QGauss<dim>(std::max(parameters.coupling_quadrature_order, 2 * fe_sub->degree + 1));
+    }
+
+    template<int dim, int spacedim>
+    std::vector<Point<spacedim>> DistributedLagrangeProblem<dim, spacedim>::embedded_support_points() const {
+        const std::vector<Point<dim>> &unit_points = fe_sub->get_unit_support_points();
+        const auto &data = embedded_mapping_cache.get(*sub_domain_mapping, *dof_handler_sub,
+                                                      Quadrature<dim>(unit_points,
+                                                                      std::vector<double>(unit_points.size(), 1.)));
+        std::vector<Point<spacedim>> support_points(dof_handler_sub->n_dofs());
+        for (unsigned int i = 0; i < embedded_cell_dofs.size(); ++i)
+            support_points[embedded_cell_dofs[i]] = data.points[i];
+        return support_points;
+    }
 
+    template<int dim, int spacedim>
+    void DistributedLagrangeProblem<dim, spacedim>::assemble_stiffness_matrix() {
+        //Assemble the matrix whit fancy function contrary to the usual loop
+        const SectionScope timer_section(monitor, counters, "Assemble System");
+        // the rhs only get the contribution of the inhomogeneous boundary values
+        stiffnes_matrix = 0;
+        rhs = 0;
+        if (!parameters.reference_cell_matrix || !is_cartesian_mesh()) {
+            MatrixTools::create_laplace_matrix(*dof_handler, QGauss<spacedim>(2 * fe->degree + 1), stiffnes_matrix,
+                                               Functions::ZeroFunction<spacedim>(), rhs,
+                                               static_cast<const Function<spacedim> *>(nullptr), constraints);
+            return;
         }
-        {// Assemble coupling systeme and the G function whit fancy function because it allow to group all mapping of the two mesh in one object
-            {
-                TimerOutput::Scope timer_section(monitor, "Assemble Coupling - Mass Matrix");
-                QGauss<dim> quad(parameters.coupling_quadrature_order);
-                NonMatching::create_coupling_mass_matrix(*mesh_tools, *dof_handler, *dof_handler_sub, quad,
-                                                         coupling_matrix,
-                                                         AffineConstraints < double > (), ComponentMask(),
-                                                         ComponentMask(),
-                                                         *sub_domain_mapping);
+
+        // the laplace matrix of a cube of side h is h^(spacedim-2) times the one of the unit cube,
+        // so the quadrature is only done on the first cell
+        const unsigned int dofs_per_cell = fe->dofs_per_cell;
+        const QGauss<spacedim> quad(2 * fe->degree + 1);
+        FEValues<spacedim> fe_values(*fe, quad, update_gradients | update_JxW_values);
+        const auto first_cell = dof_handler->begin_active();
+        fe_values.reinit(first_cell);
+        FullMatrix<double> reference_matrix(dofs_per_cell, dofs_per_cell);
+        for (unsigned int q = 0; q < quad.size(); ++q)
+            for (unsigned int i = 0; i < dofs_per_cell; ++i)
+                for (unsigned int j = 0; j < dofs_per_cell; ++j)
+                    reference_matrix(i, j) += fe_values.shape_grad(i, q) * fe_values.shape_grad(j, q) *
+                                              fe_values.JxW(q);
+        reference_matrix /= std::pow(first_cell->vertex(1)[0] - first_cell->vertex(0)[0], spacedim - 2.);
+
+        // only scatter, the constraints give the rhs of the boundary values as create_laplace_matrix does
+        FullMatrix<double> cell_matrix(dofs_per_cell, dofs_per_cell);
+        const Vector<double> cell_rhs(dofs_per_cell);
+        std::vector<types::global_dof_index> dof_indices(dofs_per_cell);
+        for (const auto &cell : dof_handler->active_cell_iterators()) {
+            cell->get_dof_indices(dof_indices);
+            if (spacedim == 2)
+                constraints.distribute_local_to_global(reference_matrix, cell_rhs, dof_indices, stiffnes_matrix,
+                                                       rhs);
+            else {
+                cell_matrix = reference_matrix;
+                cell_matrix *= std::pow(cell->vertex(1)[0] - cell->vertex(0)[0], spacedim - 2.);
+                constraints.distribute_local_to_global(cell_matrix, cell_rhs, dof_indices, stiffnes_matrix, rhs);
             }
-            {
-                TimerOutput::Scope timer_section(monitor, "Assemble Coupling - Interpolation");
+        }
+    }
 
-                VectorTools::interpolate(*sub_domain_mapping, *dof_handler_sub, sub_domain_value_function,
-                                         sub_domain_value);
+    template<int dim, int spacedim>
+    bool DistributedLagrangeProblem<dim, spacedim>::is_cartesian_mesh() const {
+        for (const auto &cell : mesh->active_cell_iterators()) {
+            const double h = cell->vertex(1)[0] - cell->vertex(0)[0];
+            if (h <= 0)
+                return false;
+            for (unsigned int v = 0; v < GeometryInfo<spacedim>::vertices_per_cell; ++v) {
+                const Point<spacedim> cube_vertex = cell->vertex(0) + h * (GeometryInfo<spacedim>::unit_cell_vertex(v) -
+                                                                           Point<spacedim>());
+                if (cube_vertex.distance(cell->vertex(v)) > 1e-10 * h)
+                    return false;
             }
+        }
+        return true;
+    }
+
+    template<int dim, int spacedim>
+    void DistributedLagrangeProblem<dim, spacedim>::coupling_mass_sparsity(DynamicSparsityPattern &dsp) const {
+        //match the two grid value  whit the systeme containe in a single object
+        NonMatching::create_coupling_sparsity_pattern(*mesh_tools, *dof_handler, *dof_handler_sub,
+                                                      QGauss<dim>(parameters.coupling_quadrature_order), dsp,
+                                                      AffineConstraints<double>(), ComponentMask(),
+                                                      ComponentMask(), *sub_domain_mapping);
+    }
+
+    template<int dim, int spacedim>
+    void DistributedLagrangeProblem<dim, spacedim>::assemble_coupling_matrix(SparseMatrix<double> &matrix) {
+        // Assemble coupling systeme whit fancy function because it allow to group all mapping of the two mesh in one object
+        const SectionScope timer_section(monitor, counters, "Assemble Coupling - Mass Matrix");
+        QGauss<dim> quad(parameters.coupling_quadrature_order);
+        NonMatching::create_coupling_mass_matrix(*mesh_tools, *dof_handler, *dof_handler_sub, quad,
+                                                 matrix,
+                                                 AffineConstraints < double > (), ComponentMask(),
+                                                 ComponentMask(),
+                                                 *sub_domain_mapping);
+    }
+
+    template<int dim, int spacedim>
+    void DistributedLagrangeProblem<dim, spacedim>::assemble_embedded_rhs(const Function<spacedim> &value_function) {
+        {// right hand side of the embedded probleme
+            const SectionScope timer_section(monitor, counters, "Assemble System");
+            VectorTools::create_right_hand_side(*sub_domain_mapping, *dof_handler_sub,
+                                                QGauss<dim>(2 * fe_sub->degree + 1), value_function, sub_domain_rhs);
+        }
+        {// the G function
+            const SectionScope timer_section(monitor, counters, "Assemble Coupling - Interpolation");
 
+            VectorTools::interpolate(*sub_domain_mapping, *dof_handler_sub, value_function,
+                                     sub_domain_value);
         }
     }
 
 
+    template<int dim, int spacedim>
+    void DistributedLagrangeProblem<dim, spacedim>::factorize_stiffness_matrix() {
+        if (K_factorized)
+            return;
+        const std::size_t memory_before = heap_in_use();
+        K_inv_umfpack.initialize(stiffnes_matrix);
+        K_factorized = true;
+        const std::size_t memory_after = heap_in_use();
+        K_inv_memory = (memory_after > memory_before ? memory_after - memory_before : 0);
+    }
+
+    template<int dim, int spacedim>
+    void DistributedLagrangeProblem<dim, spacedim>::assemble_embedded_system(const Function<spacedim> &value_function) {
+        const SectionScope timer_section(monitor, counters, "Assemble Embedded - Fused");
+
+        // the mapped points come from the cache, only the first call after a change of configuration
+        // evaluate the mapping
+        const QGauss<dim> quad = embedded_quadrature();
+        const unsigned int n_q_points = quad.size();
+        const auto &data = embedded_mapping_cache.get(*sub_domain_mapping, *dof_handler_sub, quad);
+        const std::vector<Point<spacedim>> support_points = embedded_support_points();
+
+        // the shape functions of FE_Q do not depend on the cell
+        const unsigned int dofs_per_cell_sub = fe_sub->dofs_per_cell;
+        FullMatrix<double> shape_sub(n_q_points, dofs_per_cell_sub);
+        for (unsigned int q = 0; q < n_q_points; ++q)
+            for (unsigned int j = 0; j < dofs_per_cell_sub; ++j)
+                shape_sub(q, j) = fe_sub->shape_value(j, quad.point(q));
+
+        // rhs of the embedded probleme
+        std::vector<double> values(data.points.size());
+        value_function.value_list(data.points, values);
+        sub_domain_rhs = 0;
+        for (unsigned int c = 0; c < mesh_sub->n_active_cells(); ++c)
+            for (unsigned int q = 0; q < n_q_points; ++q) {
+                const unsigned int point = c * n_q_points + q;
+                for (unsigned int j = 0; j < dofs_per_cell_sub; ++j)
+                    sub_domain_rhs(embedded_cell_dofs[c * dofs_per_cell_sub + j]) +=
+                            values[point] * shape_sub(q, j) * data.JxW[point];
+            }
+
+        // the G function
+        std::vector<double> support_values(support_points.size());
+        value_function.value_list(support_points, support_values);
+        for (unsigned int i = 0; i < support_values.size(); ++i)
+            sub_domain_value(i) = support_values[i];
+
+        // coupling matrix on the embedding cells found whit the coupling sparsity
+        coupling_matrix = 0;
+        const auto &cells = std::get<0>(embedded_point_locations);
+        const auto &reference_points = std::get<1>(embedded_point_locations);
+        const auto &maps = std::get<2>(embedded_point_locations);
+
+        const unsigned int dofs_per_cell = fe->dofs_per_cell;
+        std::vector<types::global_dof_index> local_dofs(dofs_per_cell);
+        std::vector<types::global_dof_index> coupled_dofs_sub(dofs_per_cell_sub);
+        FullMatrix<double> local_matrix(dofs_per_cell, dofs_per_cell_sub);
+        for (unsigned int c = 0; c < cells.size(); ++c) {
+            const typename DoFHandler<spacedim>::active_cell_iterator cell(&*mesh, cells[c]->level(),
+                                                                           cells[c]->index(), dof_handler.get());
+            cell->get_dof_indices(local_dofs);
+
+            // the points of the same embedded cell follow each other, one local matrix for each
+            unsigned int current_cell_sub = numbers::invalid_unsigned_int;
+            for (unsigned int q = 0; q < maps[c].size(); ++q) {
+                const unsigned int point = maps[c][q];
+                const unsigned int cell_sub = point / n_q_points;
+                if (cell_sub != current_cell_sub) {
+                    if (current_cell_sub != numbers::invalid_unsigned_int)
+                        coupling_matrix.add(local_dofs, coupled_dofs_sub, local_matrix);
+                    current_cell_sub = cell_sub;
+                    local_matrix = 0;
+                    std::copy(embedded_cell_dofs.begin() + cell_sub * dofs_per_cell_sub,
+                              embedded_cell_dofs.begin() + (cell_sub + 1) * dofs_per_cell_sub,
+                              coupled_dofs_sub.begin());
+                }
+                for (unsigned int i = 0; i < dofs_per_cell; ++i) {
+                    const double phi_JxW = fe->shape_value(i, reference_points[c][q]) * data.JxW[point];
+                    for (unsigned int j = 0; j < dofs_per_cell_sub; ++j)
+                        local_matrix(i, j) += phi_JxW * shape_sub(point % n_q_points, j);
+                }
+            }
+            if (current_cell_sub != numbers::invalid_unsigned_int)
+                coupling_matrix.add(local_dofs, coupled_dofs_sub, local_matrix);
+        }
+    }
+
     template<int dim, int spacedim>
     void DistributedLagrangeProblem<dim, spacedim>::solve() {
         //solve the probleme
-        TimerOutput::Scope timer_section(monitor, "Solve");
+        const SectionScope timer_section(monitor, counters, "Solve");
         // developpe the inverse of the the stiffness matrix
 
-        SparseDirectUMFPACK K_inv_umfpack;
-        K_inv_umfpack.initialize(stiffnes_matrix);
+        factorize_stiffness_matrix();
         auto K = linear_operator(stiffnes_matrix);
-        auto Ct = linear_operator(coupling_matrix);
+        auto Ct = linear_operator(coupling_operator);
         auto C = transpose_operator(Ct);
         auto K_inv = linear_operator(K, K_inv_umfpack);
 
 
 
-        //Schur Complement method
-        auto S = C * K_inv * Ct;
+        //Schur Complement method, the three products in a single operator so the CG iterations do not allocate
+        schur_operator.reinit(coupling_operator, K_inv_umfpack);
+        const auto S = linear_operator(schur_operator);
         //base on step 20 methode whit schur operator
 
         //IterationNumberControl iteration_number_control_aS(30, 1.e-11);
         //SolverCG<>             solver_aS(iteration_number_control_aS);
         //const auto preconditioner_S = inverse_operator(S,solver_aS, PreconditionIdentity());
         SolverCG<Vector<double>> solver_cg(schur_solver_control);
-        auto S_inv = inverse_operator(S, solver_cg,PreconditionIdentity());
-        lambda = S_inv * sub_domain_rhs;
-        solution = K_inv * Ct * lambda;
+        const bool banded_preconditioner =
+                (parameters.schur_preconditioner == "banded" && setup_schur_preconditioner(S));
+        auto S_inv = (banded_preconditioner ? inverse_operator(S, solver_cg, schur_preconditioner)
+                                            : inverse_operator(S, solver_cg, PreconditionIdentity()));
+        // whit a rhs in the embedding space: S lambda = G - C K^-1 rhs and u = K^-1 (rhs + Ct lambda)
+        if (rhs.l2_norm() != 0) {
+            lambda = S_inv * (sub_domain_rhs - C * K_inv * rhs);
+            solution = K_inv * (rhs + Ct * lambda);
+        } else {
+            lambda = S_inv * sub_domain_rhs;
+            solution = K_inv * Ct * lambda;
+        }
         constraints.distribute(solution);
     }
 
+    template<int dim, int spacedim>
+    bool DistributedLagrangeProblem<dim, spacedim>::setup_schur_preconditioner(const LinearOperator<Vector<double>> &S) {
+        if (schur_preconditioner_ready)
+            return schur_preconditioner.is_factorized();
+        schur_preconditioner_ready = true;
+
+        // the dofs i and j have the same color when they are more than 2b apart, so the product of S whit the
+        // sum of the unit vectors of a color give each entry of the band whit an error made of the far entries
+        // ( small when the dofs follow the curve)
+        const unsigned int n = dof_handler_sub->n_dofs();
+        if (n == 0)
+            return false;
+        const unsigned int bandwidth = std::min(parameters.schur_preconditioner_bandwidth, n - 1);
+        const unsigned int n_colors = std::min(2 * bandwidth + 1, n);
+        schur_preconditioner.reinit(n, bandwidth);
+        Vector<double> probe(n), product(n);
+        for (unsigned int color = 0; color < n_colors; ++color) {
+            probe = 0.;
+            for (unsigned int j = color; j < n; j += n_colors)
+                probe(j) = 1.;
+            S.vmult(product, probe);
+            // S is symmetric, the two values read for (i,j) and (j,i) are averaged
+            for (unsigned int j = color; j < n; j += n_colors)
+                for (unsigned int i = (j > bandwidth ? j - bandwidth : 0); i <= std::min(j + bandwidth, n - 1); ++i) {
+                    if (i >= j)
+                        schur_preconditioner(i, j) += 0.5 * product(i);
+                    if (i <= j)
+                        schur_preconditioner(j, i) += 0.5 * product(i);
+                }
+        }
+        if (!schur_preconditioner.factorize()) {
+            deallog << "The band of the schur complement is not positive definite, CG whitout preconditioner"
+                    << std::endl;
+            return false;
+        }
+        deallog << "Banded schur preconditioner: bandwidth " << bandwidth << ", " << n_colors
+                << " schur applications" << std::endl;
+        return true;
+    }
+
     template<int dim, int spacedim>
     void DistributedLagrangeProblem<dim, spacedim>::solve_direct() {
         //solve the probleme
-        TimerOutput::Scope timer_section(monitor, "Solve");
+        const SectionScope timer_section(monitor, counters, "Solve");
         // developpe the inverse of the the stiffness matrix
 
-        SparseDirectUMFPACK K_inv_umfpack;
-        K_inv_umfpack.initialize(stiffnes_matrix);
+        factorize_stiffness_matrix();
         auto K = linear_operator(stiffnes_matrix);
-        auto Ct = linear_operator(coupling_matrix);
+        auto Ct = linear_operator(coupling_operator);
         auto C = transpose_operator(Ct);
         auto K_inv = linear_operator(K, K_inv_umfpack);
 
@@ -482,34 +1594,427 @@ namespace mystep60 {
         //SolverCG<Vector<double>> solver_cg(schur_solver_control);
         //auto S_inv = inverse_operator(S, solver_cg,PreconditionIdentity());
         //auto S_inv = linear_operator(S,L_inv_umfpack);
-        L_inv_umfpack.vmult(lambda,sub_domain_rhs);
-        solution = K_inv * Ct * lambda;
+        Vector<double> schur_rhs(sub_domain_rhs);
+        if (rhs.l2_norm() != 0)
+            schur_rhs = sub_domain_rhs - C * K_inv * rhs;
+        L_inv_umfpack.vmult(lambda,schur_rhs);
+        solution = K_inv * (rhs + Ct * lambda);
         constraints.distribute(solution);
     }
 
     template<int dim, int spacedim>
-    void DistributedLagrangeProblem<dim, spacedim>::output() {
+    void DistributedLagrangeProblem<dim, spacedim>::setup_functions() {
+        configuration_evaluator = make_function<spacedim>(configuration_definition, {},
+                                                          parameters.compiled_expressions);
+        sub_domain_value_evaluator = make_function<spacedim>(sub_domain_value_definition, {},
+                                                             parameters.compiled_expressions);
+    }
 
-        TimerOutput::Scope timer_section(monitor, "Output results");
-        DataOut<spacedim> embedding_out;
+    template<int dim, int spacedim>
+    void DistributedLagrangeProblem<dim, spacedim>::interpolate_configuration(const Function<spacedim> &function) {
+        // same support points than VectorTools::interpolate ( Q1 mapping of the reference embedded mesh)
+        std::vector<Point<spacedim>> support_points(configuration_dof_handler->n_dofs());
+        DoFTools::map_dofs_to_support_points(MappingQGeneric<dim, spacedim>(1), *configuration_dof_handler,
+                                             support_points);
+
+        std::vector<bool> component_dofs(configuration_dof_handler->n_dofs());
+        std::vector<Point<spacedim>> points;
+        std::vector<double> values;
+        for (unsigned int c = 0; c < spacedim; ++c) {
+            DoFTools::extract_dofs(*configuration_dof_handler,
+                                   configuration_FE->component_mask(FEValuesExtractors::Scalar(c)), component_dofs);
+            points.clear();
+            for (unsigned int i = 0; i < component_dofs.size(); ++i)
+                if (component_dofs[i])
+                    points.push_back(support_points[i]);
+            values.resize(points.size());
+            function.value_list(points, values, c);
+            unsigned int n = 0;
+            for (unsigned int i = 0; i < component_dofs.size(); ++i)
+                if (component_dofs[i])
+                    configuration(i) = values[n++];
+        }
+        // the embedded domain moved
+        embedded_mapping_cache.clear();
+    }
+
+    template<int dim, int spacedim>
+    void DistributedLagrangeProblem<dim, spacedim>::setup_manufactured_solution() {
+        AssertThrow(spacedim == 2, ExcMessage("The manufactured solution is only harmonic in 2D."));
+        const auto &constants = configuration_definition.constants;
+        AssertThrow(constants.count("R") != 0 && constants.count("Cx") != 0 && constants.count("Cy") != 0,
+                    ExcMessage("The manufactured solution need the constants R, Cx and Cy of the circle "
+                               "R*cos(2*pi*x)+Cx; R*sin(2*pi*x)+Cy as embedded configuration."));
+        Point<spacedim> center;
+        center[0] = constants.at("Cx");
+        center[1] = constants.at("Cy");
+        manufactured_solution = std_cxx14::make_unique<ManufacturedSolution<spacedim>>(center, constants.at("R"));
+    }
+
+    template<int dim, int spacedim>
+    std::array<double, 3> DistributedLagrangeProblem<dim, spacedim>::compute_errors() const {
+        std::array<double, 3> errors;
+        Vector<float> difference_per_cell(mesh->n_active_cells());
+        const QGauss<spacedim> quad(2 * fe->degree + 1);
+        VectorTools::integrate_difference(*dof_handler, solution, *manufactured_solution, difference_per_cell, quad,
+                                          VectorTools::L2_norm);
+        errors[0] = VectorTools::compute_global_error(*mesh, difference_per_cell, VectorTools::L2_norm);
+        VectorTools::integrate_difference(*dof_handler, solution, *manufactured_solution, difference_per_cell, quad,
+                                          VectorTools::H1_seminorm);
+        errors[1] = VectorTools::compute_global_error(*mesh, difference_per_cell, VectorTools::H1_seminorm);
+
+        Vector<float> difference_per_cell_sub(mesh_sub->n_active_cells());
+        VectorTools::integrate_difference(*sub_domain_mapping, *dof_handler_sub, lambda,
+                                          Functions::ConstantFunction<spacedim>(manufactured_solution->lambda()),
+                                          difference_per_cell_sub, QGauss<dim>(2 * fe_sub->degree + 1),
+                                          VectorTools::L2_norm);
+        errors[2] = VectorTools::compute_global_error(*mesh_sub, difference_per_cell_sub, VectorTools::L2_norm);
+
+        deallog << "Errors: u L2 " << errors[0] << ", u H1 " << errors[1] << ", lambda L2 " << errors[2]
+                << std::endl;
+        return errors;
+    }
+
+    template<int dim, int spacedim>
+    void DistributedLagrangeProblem<dim, spacedim>::print_errors() const {
+        std::cout << std::endl << "stage  embedding dofs  embedded dofs  u L2 error  u H1 error  lambda L2 error"
+                                  "  wall time" << std::endl;
+        double wall_time = 0;
+        for (const auto &stage : statistics) {
+            for (const auto &section : stage.sections)
+                wall_time += section.second[1];
+            std::cout << stage.stage << "  " << stage.n_dofs << "  " << stage.n_dofs_sub << "  " << stage.errors[0]
+                      << "  " << stage.errors[1] << "  " << stage.errors[2] << "  " << wall_time << std::endl;
+        }
+    }
 
-        std::ofstream embedding_out_file("embedding.vtu");
+    template<int dim, int spacedim>
+    void DistributedLagrangeProblem<dim, spacedim>::output(const std::string &suffix, const int cycle) {
+
+        const SectionScope timer_section(monitor, counters, "Output results");
+        Timer timer;
+        using active_cell_iterator = typename Triangulation<spacedim>::active_cell_iterator;
+        using cell_iterator = typename DataOut<spacedim>::cell_iterator;
+
+        // piece of each active cell of the embedding mesh, invalid for the cells that are not written
+        const auto cell_piece = std::make_shared<std::vector<unsigned int>>(mesh->n_active_cells(),
+                                                                            numbers::invalid_unsigned_int);
+        unsigned int n_pieces = (parameters.output_format == "vtu" ? std::max(parameters.output_pieces, 1u) : 1);
+        {
+            std::vector<bool> selected(mesh->n_active_cells(), true);
+            if (parameters.output_cells == "band")
+                // the size of the file then follow the length of the interface and not the area of the domain
+                selected = interface_band(parameters.output_band_layers);
+            const unsigned int n_selected = std::count(selected.begin(), selected.end(), true);
+            AssertThrow(n_selected > 0, ExcMessage("No cell of the embedding mesh is selected for the output."));
+            n_pieces = std::min(n_pieces, n_selected);
+
+            // consecutive cells go in the same piece so each piece is a compact part of the mesh
+            // ( whit MPI the piece would simply be the subdomain of the cell)
+            std::size_t n_seen = 0;
+            for (unsigned int i = 0; i < selected.size(); ++i)
+                if (selected[i]) {
+                    (*cell_piece)[i] = n_seen * n_pieces / n_selected;
+                    ++n_seen;
+                }
+        }
+
+        // one DataOut per piece, shared so a background task can keep them
+        std::vector<std::shared_ptr<DataOut<spacedim>>> embedding_out(n_pieces);
+        Threads::TaskGroup<void> patch_tasks;
+        for (unsigned int piece = 0; piece < n_pieces; ++piece) {
+            const auto next_in_piece = [cell_piece, piece](const Triangulation<spacedim> &tria,
+                                                           active_cell_iterator cell) {
+                for (; cell != tria.end(); ++cell)
+                    if ((*cell_piece)[cell->active_cell_index()] == piece)
+                        return cell_iterator(cell);
+                return cell_iterator(tria.end());
+            };
+
+            embedding_out[piece] = std::make_shared<DataOut<spacedim>>();
 // ouput domain results
-        embedding_out.attach_dof_handler(*dof_handler);
-        embedding_out.add_data_vector(solution, "solution");
-        embedding_out.build_patches(parameters.embedded_fe_deg);
-        embedding_out.write_vtu(embedding_out_file);
+            embedding_out[piece]->attach_dof_handler(*dof_handler);
+            embedding_out[piece]->add_data_vector(solution, "solution");
+            embedding_out[piece]->set_cell_selection(
+                    [next_in_piece](const Triangulation<spacedim> &tria) -> cell_iterator {
+                        return next_in_piece(tria, tria.begin_active());
+                    },
+                    [next_in_piece](const Triangulation<spacedim> &tria, const cell_iterator &cell) -> cell_iterator {
+                        active_cell_iterator next = cell;
+                        return next_in_piece(tria, ++next);
+                    });
+            const auto piece_out = embedding_out[piece];
+            patch_tasks += Threads::new_task(std::function<void()>([this, piece_out]() -> void {
+                piece_out->build_patches(parameters.embedded_fe_deg);
+            }));
+        }
 
         // output subdomain results
-        DataOut<dim, DoFHandler<dim, spacedim>> embedded_out;
-        std::ofstream embedded_out_file("embedded.vtu");
-        embedded_out.attach_dof_handler(*dof_handler_sub);
-        embedded_out.add_data_vector(lambda, "lambda");
-        embedded_out.add_data_vector(sub_domain_value, "g");
-        embedded_out.build_patches(*sub_domain_mapping,
-                                   parameters.domain_fe_deg);
+        auto embedded_out = std::make_shared<DataOut<dim, DoFHandler<dim, spacedim>>>();
+        embedded_out->attach_dof_handler(*dof_handler_sub);
+        embedded_out->add_data_vector(lambda, "lambda");
+        embedded_out->add_data_vector(sub_domain_value, "g");
+        embedded_out->build_patches(*sub_domain_mapping,
+                                    parameters.domain_fe_deg);
+        patch_tasks.join_all();
+
+        std::vector<std::string> files;
+        if (parameters.write_binary_results) {
+            output_binary(suffix);
+            files.push_back(output_file("results" + suffix + ".bin"));
+        }
+        const std::string embedding_extension = (n_pieces > 1 ? ".pvtu" : ".vtu");
+
+        // hdf5 is not thread safe, only the vtu files are written in the background
+        if (parameters.asynchronous_output && parameters.output_format == "vtu") {
+            // the patches are a copy of the mesh and the vectors, so the DataOut can let go of the
+            // dofs and vectors and the next local_refine() can change them while the files are written
+            for (const auto &piece_out : embedding_out)
+                piece_out->clear_input_data_references();
+            embedded_out->clear_input_data_references();
+
+            while (output_tasks.size() >= std::max(parameters.output_queue_length, 1u)) {
+                output_tasks.front().join();
+                output_tasks.pop_front();
+            }
+            output_tasks.push_back(Threads::new_task(std::function<void()>(
+                    [this, embedding_out, embedded_out, suffix, files, cycle, embedding_extension]() -> void {
+                        Timer write_timer;
+                        std::vector<std::string> all_files = write_vtu(embedding_out, *embedded_out, suffix);
+                        all_files.insert(all_files.end(), files.begin(), files.end());
+                        report_output(all_files, write_timer.wall_time());
+                        // only point to the files once they are complete
+                        if (cycle >= 0)
+                            add_pvd_record(cycle, suffix, embedding_extension);
+                    })));
+            return;
+        }
+
+        std::vector<std::string> written_files;
+        if (parameters.output_format == "hdf5")
+            written_files = write_hdf5(*embedding_out[0], *embedded_out, suffix);
+        else {
+            written_files = write_vtu(embedding_out, *embedded_out, suffix);
+            if (cycle >= 0)
+                add_pvd_record(cycle, suffix, embedding_extension);
+        }
+        written_files.insert(written_files.end(), files.begin(), files.end());
+        report_output(written_files, timer.wall_time());
+    }
+
+    template<int dim, int spacedim>
+    void DistributedLagrangeProblem<dim, spacedim>::add_pvd_record(const int cycle, const std::string &suffix,
+                                                                   const std::string &embedding_extension) {
+        std::lock_guard<std::mutex> lock(pvd_mutex);
+
+        // the pvd is in the same directory than the vtu so the names are relative
+        embedding_pvd_records.emplace_back(cycle, "embedding" + suffix + embedding_extension);
+        embedded_pvd_records.emplace_back(cycle, "embedded" + suffix + ".vtu");
+        // the background output can finish in any order
+        std::sort(embedding_pvd_records.begin(), embedding_pvd_records.end());
+        std::sort(embedded_pvd_records.begin(), embedded_pvd_records.end());
+
+        std::ofstream embedding_pvd(output_file("embedding.pvd"));
+        DataOutBase::write_pvd_record(embedding_pvd, embedding_pvd_records);
+        std::ofstream embedded_pvd(output_file("embedded.pvd"));
+        DataOutBase::write_pvd_record(embedded_pvd, embedded_pvd_records);
+    }
+
+    template<int dim, int spacedim>
+    std::vector<bool> DistributedLagrangeProblem<dim, spacedim>::interface_band(const unsigned int n_layers) const {
+        using active_cell_iterator = typename Triangulation<spacedim>::active_cell_iterator;
+        std::vector<bool> band(mesh->n_active_cells(), false);
+
+        // the cells that contain the support points of the embedded domain are the center of the band
+        const auto point_locations = GridTools::compute_point_locations(*mesh_tools, embedded_support_points());
+
+        std::vector<active_cell_iterator> front;
+        for (const auto &cell : std::get<0>(point_locations))
+            if (!band[cell->active_cell_index()]) {
+                band[cell->active_cell_index()] = true;
+                front.push_back(cell);
+            }
+
+        // add the active neighbors one layer at a time, they can be coarser or finer than the cell
+        for (unsigned int layer = 0; layer < n_layers; ++layer) {
+            std::vector<active_cell_iterator> next_front;
+            for (const auto &cell : front) {
+                std::vector<active_cell_iterator> neighbors;
+                GridTools::get_active_neighbors<Triangulation<spacedim>>(cell, neighbors);
+                for (const auto &neighbor : neighbors)
+                    if (!band[neighbor->active_cell_index()]) {
+                        band[neighbor->active_cell_index()] = true;
+                        next_front.push_back(neighbor);
+                    }
+            }
+            front.swap(next_front);
+        }
+        return band;
+    }
+
+    template<int dim, int spacedim>
+    void DistributedLagrangeProblem<dim, spacedim>::report_output(const std::vector<std::string> &files,
+                                                                  const double wall_time) const {
+        // size on disk of what was just written
+        std::size_t n_bytes = 0;
+        for (const auto &file : files) {
+            struct stat status;
+            if (stat(file.c_str(), &status) == 0)
+                n_bytes += status.st_size;
+        }
+        deallog << "Output results: " << files.size() << " files, " << n_bytes / 1024. << " KB written in "
+                << wall_time << " s" << std::endl;
+    }
+
+    template<int dim, int spacedim>
+    void DistributedLagrangeProblem<dim, spacedim>::wait_for_output() {
+        while (!output_tasks.empty()) {
+            output_tasks.front().join();
+            output_tasks.pop_front();
+        }
+    }
+
+    template<int dim, int spacedim>
+    std::vector<std::string>
+    DistributedLagrangeProblem<dim, spacedim>::write_vtu(
+            const std::vector<std::shared_ptr<DataOut<spacedim>>> &embedding_out,
+            DataOut<dim, DoFHandler<dim, spacedim>> &embedded_out,
+            const std::string &suffix) const {
+        // vtu data are written in binary zlib blocks when deal.II has zlib, the level only change the speed/size ratio
+        DataOutBase::VtkFlags flags;
+        if (parameters.output_compression == "no_compression")
+            flags.compression_level = DataOutBase::VtkFlags::no_compression;
+        else if (parameters.output_compression == "best_speed")
+            flags.compression_level = DataOutBase::VtkFlags::best_speed;
+        else if (parameters.output_compression == "default_compression")
+            flags.compression_level = DataOutBase::VtkFlags::default_compression;
+        else
+            flags.compression_level = DataOutBase::VtkFlags::best_compression;
+        for (const auto &piece_out : embedding_out)
+            piece_out->set_flags(flags);
+        embedded_out.set_flags(flags);
+
+        std::vector<std::string> files = {output_file("embedded" + suffix + ".vtu")};
+        std::ofstream embedded_out_file(files[0]);
         embedded_out.write_vtu(embedded_out_file);
 
+        if (embedding_out.size() == 1) {
+            files.push_back(output_file("embedding" + suffix + ".vtu"));
+            std::ofstream embedding_out_file(files.back());
+            embedding_out[0]->write_vtu(embedding_out_file);
+            return files;
+        }
+
+        // one file per piece written in parallel and a pvtu that list them ( relative names)
+        std::vector<std::string> piece_names(embedding_out.size());
+        Threads::TaskGroup<void> write_tasks;
+        for (unsigned int piece = 0; piece < embedding_out.size(); ++piece) {
+            piece_names[piece] = "embedding" + suffix + "." + Utilities::int_to_string(piece, 4) + ".vtu";
+            files.push_back(output_file(piece_names[piece]));
+            const auto piece_out = embedding_out[piece];
+            const std::string piece_file = files.back();
+            write_tasks += Threads::new_task(std::function<void()>([piece_out, piece_file]() -> void {
+                std::ofstream piece_out_file(piece_file);
+                piece_out->write_vtu(piece_out_file);
+            }));
+        }
+        files.push_back(output_file("embedding" + suffix + ".pvtu"));
+        std::ofstream pvtu_file(files.back());
+        embedding_out[0]->write_pvtu_record(pvtu_file, piece_names);
+        write_tasks.join_all();
+        return files;
+    }
+
+    template<int dim, int spacedim>
+    std::vector<std::string>
+    DistributedLagrangeProblem<dim, spacedim>::write_hdf5(DataOut<spacedim> &embedding_out,
+                                                          DataOut<dim, DoFHandler<dim, spacedim>> &embedded_out,
+                                                          const std::string &suffix) const {
+#ifdef DEAL_II_WITH_HDF5
+        // deal.II create a new .h5 at each write, so each domain get its own file and
+        // the xdmf file put the two grids in the same spatial collection
+        const std::string embedding_h5 = "embedding" + suffix + ".h5";
+        const std::string embedded_h5 = "embedded" + suffix + ".h5";
+        const std::string xdmf = "solution" + suffix + ".xdmf";
+
+        DataOutBase::DataOutFilter embedding_filter(DataOutBase::DataOutFilterFlags(true, true));
+        embedding_out.write_filtered_data(embedding_filter);
+        embedding_out.write_hdf5_parallel(embedding_filter, output_file(embedding_h5), MPI_COMM_SELF);
+        const XDMFEntry embedding_entry = embedding_out.create_xdmf_entry(embedding_filter, embedding_h5, 0,
+                                                                          MPI_COMM_SELF);
+
+        DataOutBase::DataOutFilter embedded_filter(DataOutBase::DataOutFilterFlags(true, true));
+        embedded_out.write_filtered_data(embedded_filter);
+        embedded_out.write_hdf5_parallel(embedded_filter, output_file(embedded_h5), MPI_COMM_SELF);
+        const XDMFEntry embedded_entry = embedded_out.create_xdmf_entry(embedded_filter, embedded_h5, 0,
+                                                                        MPI_COMM_SELF);
+
+        std::ofstream xdmf_file(output_file(xdmf));
+        xdmf_file << "<?xml version=\"1.0\" ?>" << std::endl
+                  << "<!DOCTYPE Xdmf SYSTEM \"Xdmf.dtd\" []>" << std::endl
+                  << "<Xdmf Version=\"2.0\">" << std::endl
+                  << "  <Domain>" << std::endl
+                  << "    <Grid Name=\"Distributed Lagrange\" GridType=\"Collection\" CollectionType=\"Spatial\">"
+                  << std::endl
+                  << embedding_entry.get_xdmf_content(3)
+                  << embedded_entry.get_xdmf_content(3)
+                  << "    </Grid>" << std::endl
+                  << "  </Domain>" << std::endl
+                  << "</Xdmf>" << std::endl;
+
+        return {output_file(embedding_h5), output_file(embedded_h5), output_file(xdmf)};
+#else
+        (void)embedding_out;
+        (void)embedded_out;
+        (void)suffix;
+        AssertThrow(false, ExcMessage("deal.II was not configured whit HDF5, use the vtu output format."));
+        return {};
+#endif
+    }
+
+    template<int dim, int spacedim>
+    void DistributedLagrangeProblem<dim, spacedim>::output_binary(const std::string &suffix) const {
+        AssertThrow(host_is_little_endian(),
+                    ExcMessage("The binary results can only be written on little endian machines."));
+
+        std::vector<Point<spacedim>> embedding_points(dof_handler->n_dofs());
+        DoFTools::map_dofs_to_support_points(MappingQGeneric<spacedim>(1), *dof_handler, embedding_points);
+        const std::vector<Point<spacedim>> embedded_points = embedded_support_points();
+
+        BinaryResultsHeader header;
+        header.spacedim = spacedim;
+        header.n_embedding_dofs = dof_handler->n_dofs();
+        header.n_embedded_dofs = dof_handler_sub->n_dofs();
+        set_binary_results_layout(header);
+
+        const std::string filename = output_file("results" + suffix + ".bin");
+        std::ofstream file(filename, std::ios::binary);
+        AssertThrow(file, ExcFileNotOpen(filename));
+
+        // write n values at the given position of the file, the gap before is fill whit zeros
+        const auto write_array = [&file](const std::uint64_t offset, const double *values, const std::size_t n) {
+            while (static_cast<std::uint64_t>(file.tellp()) < offset)
+                file.put(0);
+            file.write(reinterpret_cast<const char *>(values), n * sizeof(double));
+        };
+        const auto coordinates = [](const std::vector<Point<spacedim>> &points) {
+            std::vector<double> coordinates;
+            coordinates.reserve(points.size() * spacedim);
+            for (const auto &point : points)
+                for (unsigned int d = 0; d < spacedim; ++d)
+                    coordinates.push_back(point[d]);
+            return coordinates;
+        };
+
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        write_array(header.solution_offset, solution.begin(), solution.size());
+        write_array(header.embedding_points_offset, coordinates(embedding_points).data(),
+                    embedding_points.size() * spacedim);
+        write_array(header.lambda_offset, lambda.begin(), lambda.size());
+        write_array(header.sub_domain_value_offset, sub_domain_value.begin(), sub_domain_value.size());
+        write_array(header.embedded_points_offset, coordinates(embedded_points).data(),
+                    embedded_points.size() * spacedim);
+        AssertThrow(file, ExcIO());
     }
 
 
@@ -520,22 +2025,671 @@ namespace mystep60 {
         AssertThrow(parameters.initialized, ExcNotInitialized());
         deallog.depth_console(parameters.verbosity_lvl);
 
+        if (!parameters.output_directory.empty())
+            mkdir(parameters.output_directory.c_str(), 0755);
+        if (parameters.hardware_counters && !counters.is_open() && !counters.open())
+            deallog << "Hardware counters are not available ( see /proc/sys/kernel/perf_event_paranoid),"
+                       " continue whitout them" << std::endl;
+        setup_functions();
+        if (parameters.manufactured_solution)
+            setup_manufactured_solution();
+
+        if (parameters.restart_from_checkpoint) {
+            // the mesh is already adapted, only solve again whit the current parameters
+            const bool has_stiffness_matrix = load_checkpoint();
+            std::cout << "number of active cells:" << mesh->n_active_cells() << std::endl;
 
-
-        for (unsigned int cycle=0 ; cycle<3 ; ++cycle) {
-            if (cycle==0)
-            setup_grid();
+            coulpling_system();
+            // the rhs of the boundary values is assembled whit the stiffness matrix
+            if (has_stiffness_matrix && !manufactured_solution)
+                assemble_embedded_problem(*sub_domain_value_evaluator);
             else
-            local_refine();
+                define_probleme();
+            solve();
+            if (manufactured_solution)
+                errors = compute_errors();
+            record_statistics("restart");
+        } else {
+            for (unsigned int cycle = 0; cycle < parameters.n_cycles; ++cycle) {
+                if (cycle == 0)
+                    setup_grid();
+                else
+                    local_refine();
+
+                std::cout << "number of active cells:" << mesh->n_active_cells() << std::endl;
+
+                coulpling_system();
+                define_probleme();
+                solve();
+                if (manufactured_solution)
+                    errors = compute_errors();
+
+                if (parameters.output_frequency != 0 &&
+                    (cycle % parameters.output_frequency == 0 || cycle == parameters.n_cycles - 1))
+                    output("-" + Utilities::int_to_string(cycle, 4), cycle);
+
+                record_statistics(Utilities::int_to_string(cycle));
+            }
+            if (!parameters.checkpoint_file.empty())
+                save_checkpoint();
+        }
+        if (parameters.output_frequency == 0 || parameters.restart_from_checkpoint)
+            output();
+
+        if (!parameters.sweep_constants.empty() || !parameters.sweep_constants_file.empty())
+            run_sweep();
+
+        // the run is only over when everything is on disk
+        wait_for_output();
+        record_statistics("final");
+        export_statistics();
+        if (counters.is_open())
+            counters.print(std::cout);
+        if (manufactured_solution)
+            print_errors();
+    }
 
-            std::cout << "number of active cells:" << mesh->n_active_cells() << std::endl;
+    template<int dim, int spacedim>
+    void DistributedLagrangeProblem<dim, spacedim>::record_statistics(const std::string &stage) {
+        StageStatistics stage_statistics;
+        stage_statistics.stage = stage;
+        stage_statistics.n_active_cells = mesh->n_active_cells();
+        stage_statistics.n_dofs = dof_handler->n_dofs();
+        stage_statistics.n_dofs_sub = dof_handler_sub->n_dofs();
+        stage_statistics.stiffness_nnz = stiffness_sparsity.n_nonzero_elements();
+        stage_statistics.coupling_nnz = coupling_sparsity.n_nonzero_elements();
+        stage_statistics.schur_iterations = schur_solver_control.last_step();
+        Utilities::System::MemoryStats memory_stats;
+        Utilities::System::get_memory_stats(memory_stats);
+        stage_statistics.peak_memory = memory_stats.VmHWM;
+        stage_statistics.memory = memory_report();
+        stage_statistics.predicted_memory = predicted_memory;
+        predicted_memory = 0;
+        stage_statistics.errors = errors;
+
+        std::size_t total_memory = 0;
+        for (const auto &entry : stage_statistics.memory) {
+            deallog << "Memory after " << stage << ": " << entry.object << " " << entry.bytes / 1048576. << " MB"
+                    << std::endl;
+            total_memory += entry.bytes;
+        }
+        deallog << "Memory after " << stage << ": total " << total_memory / 1048576. << " MB";
+        if (stage_statistics.predicted_memory != 0)
+            deallog << " ( predicted " << stage_statistics.predicted_memory / 1048576. << " MB)";
+        deallog << ", peak RSS " << stage_statistics.peak_memory / 1024. << " MB" << std::endl;
+
+        const auto cpu_times = monitor.get_summary_data(TimerOutput::total_cpu_time);
+        const auto wall_times = monitor.get_summary_data(TimerOutput::total_wall_time);
+        const auto n_calls = monitor.get_summary_data(TimerOutput::n_calls);
+        for (const auto &section : wall_times) {
+            const std::array<double, 3> total = {{cpu_times.at(section.first), section.second,
+                                                  n_calls.at(section.first)}};
+            std::array<double, 3> &previous = recorded_sections[section.first];
+            // only the sections that were used during this stage
+            if (total[2] != previous[2])
+                stage_statistics.sections[section.first] = {{total[0] - previous[0], total[1] - previous[1],
+                                                              total[2] - previous[2]}};
+            previous = total;
+        }
+        statistics.push_back(stage_statistics);
+    }
 
-            coulpling_system();
-            define_probleme();
+    template<int dim, int spacedim>
+    void DistributedLagrangeProblem<dim, spacedim>::export_statistics() const {
+        if (parameters.statistics_format == "none")
+            return;
+
+        if (parameters.statistics_format != "csv") {
+            std::ofstream json(output_file("statistics.json"));
+            json << "[" << std::endl;
+            for (unsigned int i = 0; i < statistics.size(); ++i) {
+                const auto &stage = statistics[i];
+                json << "  {\"stage\": \"" << stage.stage << "\", \"active cells\": " << stage.n_active_cells
+                     << ", \"embedding dofs\": " << stage.n_dofs << ", \"embedded dofs\": " << stage.n_dofs_sub
+                     << ", \"stiffness nnz\": " << stage.stiffness_nnz << ", \"coupling nnz\": "
+                     << stage.coupling_nnz << ", \"schur iterations\": " << stage.schur_iterations
+                     << ", \"peak memory kB\": " << stage.peak_memory << ", \"predicted memory\": "
+                     << stage.predicted_memory << ", \"errors\": [" << stage.errors[0] << ", " << stage.errors[1]
+                     << ", " << stage.errors[2] << "], \"memory\": {";
+                for (unsigned int j = 0; j < stage.memory.size(); ++j)
+                    json << (j == 0 ? "" : ", ") << "\"" << stage.memory[j].object << "\": " << stage.memory[j].bytes;
+                json << "}, \"sections\": {";
+                unsigned int n = 0;
+                for (const auto &section : stage.sections)
+                    json << (n++ == 0 ? "" : ", ") << "\"" << section.first << "\": {\"cpu\": "
+                         << section.second[0] << ", \"wall\": " << section.second[1] << ", \"calls\": "
+                         << section.second[2] << "}";
+                json << "}}" << (i + 1 < statistics.size() ? "," : "") << std::endl;
+            }
+            json << "]" << std::endl;
+        }
+
+        if (parameters.statistics_format != "json") {
+            // one line per section and stage so it can be read directly as a table
+            std::ofstream csv(output_file("statistics.csv"));
+            csv << "stage,section,cpu,wall,calls,active cells,embedding dofs,embedded dofs,stiffness nnz,"
+                   "coupling nnz,schur iterations,peak memory kB" << std::endl;
+            for (const auto &stage : statistics)
+                for (const auto &section : stage.sections)
+                    csv << stage.stage << "," << section.first << "," << section.second[0] << ","
+                        << section.second[1] << "," << section.second[2] << "," << stage.n_active_cells << ","
+                        << stage.n_dofs << "," << stage.n_dofs_sub << "," << stage.stiffness_nnz << ","
+                        << stage.coupling_nnz << "," << stage.schur_iterations << "," << stage.peak_memory
+                        << std::endl;
+
+            // the memory of the objects does not fit the section lines, so it has its own table
+            std::ofstream memory_csv(output_file("memory.csv"));
+            memory_csv << "stage,object,bytes,predicted bytes of all objects,peak memory kB" << std::endl;
+            for (const auto &stage : statistics)
+                for (const auto &entry : stage.memory)
+                    memory_csv << stage.stage << "," << entry.object << "," << entry.bytes << ","
+                               << stage.predicted_memory << "," << stage.peak_memory << std::endl;
+        }
+    }
+
+    template<int dim, int spacedim>
+    const std::vector<typename DistributedLagrangeProblem<dim, spacedim>::StageStatistics> &
+    DistributedLagrangeProblem<dim, spacedim>::get_statistics() const {
+        return statistics;
+    }
+
+    template<int dim, int spacedim>
+    std::vector<typename DistributedLagrangeProblem<dim, spacedim>::StageTiming>
+    DistributedLagrangeProblem<dim, spacedim>::microbenchmark(const unsigned int repetitions,
+                                                              const unsigned int sell_sorting_window) {
+        AssertThrow(parameters.initialized, ExcNotInitialized());
+        AssertThrow(repetitions > 0, ExcMessage("The microbenchmark need at least one repetition."));
+        deallog.depth_console(parameters.verbosity_lvl);
+        if (!parameters.output_directory.empty())
+            mkdir(parameters.output_directory.c_str(), 0755);
+        setup_functions();
+        if (parameters.manufactured_solution)
+            setup_manufactured_solution();
+
+        std::vector<StageTiming> results;
+        const auto time_stage = [&](const std::string &name, const std::function<void()> &stage,
+                                    const double work = 0, const std::string &work_unit = "",
+                                    const double bytes = 0) {
+            StageTiming timing{name, std::numeric_limits<double>::max(), 0., work, work_unit, bytes};
+            for (unsigned int i = 0; i < repetitions; ++i) {
+                Timer timer;
+                stage();
+                timing.min_wall = std::min(timing.min_wall, timer.wall_time());
+                timing.mean_wall += timer.wall_time() / repetitions;
+            }
+            results.push_back(timing);
+        };
+
+        setup_grid();
+
+        // the same search than the local refinement of setup_grid(), the cache is already build by the first call
+        const std::vector<Point<spacedim>> support_point = embedded_support_points();
+        GridTools::compute_point_locations(*mesh_tools, support_point);
+        time_stage("point location", [&]() { GridTools::compute_point_locations(*mesh_tools, support_point); });
+
+        time_stage("coupling sparsity", [&]() { coulpling_system(); });
+        // the coupling mass matrix is always timed alone so the table is the same whit and whitout the fused
+        // assembly, the fused sparsity does not match its quadrature so it get its own sparsity
+        SparsityPattern mass_sparsity;
+        SparseMatrix<double> mass_matrix;
+        if (parameters.fused_embedded_assembly) {
+            DynamicSparsityPattern dsp(dof_handler->n_dofs(), dof_handler_sub->n_dofs());
+            coupling_mass_sparsity(dsp);
+            mass_sparsity.copy_from(dsp);
+            mass_matrix.reinit(mass_sparsity);
+        }
+        SparseMatrix<double> &timed_mass_matrix = parameters.fused_embedded_assembly ? mass_matrix : coupling_matrix;
+        time_stage("coupling mass matrix", [&]() { assemble_coupling_matrix(timed_mass_matrix); });
+        // the fused loop ( coupling, rhs and interpolation) as an extra line
+        if (parameters.fused_embedded_assembly)
+            time_stage("fused embedded assembly", [&]() { assemble_embedded_system(*sub_domain_value_evaluator); });
+        time_stage("laplace matrix", [&]() { assemble_stiffness_matrix(); });
+
+        // the two operations that depend on the order of the embedding dofs, 2 flops per non zero, the bytes
+        // are the matrix and the two vectors read once
+        Vector<double> K_src(solution.size()), K_dst(solution.size());
+        K_src = 1.;
+        const double K_flops = 2. * stiffnes_matrix.n_nonzero_elements();
+        time_stage("stiffness vmult", [&]() { stiffnes_matrix.vmult(K_dst, K_src); }, K_flops, "flops",
+                   stiffnes_matrix.n_nonzero_elements() * (sizeof(double) + sizeof(unsigned int)) +
+                   (stiffnes_matrix.m() + 1) * sizeof(std::size_t) + 2. * K_src.size() * sizeof(double));
+        // the same product in the SELL-C-sigma format
+        SellMatrix sell;
+        sell.reinit(stiffnes_matrix, sell_sorting_window);
+        time_stage("stiffness vmult sell", [&]() { sell.vmult(K_dst, K_src); }, K_flops, "flops",
+                   sell.bytes_per_vmult());
+        time_stage("stiffness factorization", [&]() {
+            K_factorized = false;
+            factorize_stiffness_matrix();
+        }, solution.size(), "dofs");
+        time_stage("embedded rhs and interpolation", [&]() { assemble_embedded_rhs(*sub_domain_value_evaluator); });
+
+        // evaluation of the embedded functions point by point ( as VectorTools does) and in one batch
+        const auto &points = embedded_mapping_cache.get(*sub_domain_mapping, *dof_handler_sub,
+                                                        embedded_quadrature()).points;
+        std::vector<double> values(points.size());
+        const auto time_function = [&](const std::string &name, const Function<spacedim> &function) {
+            time_stage(name + " point by point", [&]() {
+                for (unsigned int i = 0; i < points.size(); ++i)
+                    values[i] = function.value(points[i]);
+            }, points.size(), "points");
+            time_stage(name + " batch", [&]() { function.value_list(points, values); }, points.size(), "points");
+        };
+        time_function("embedded value", *sub_domain_value_evaluator);
+        time_function("configuration", *configuration_evaluator);
+        if (manufactured_solution)
+            time_function("manufactured solution", *manufactured_solution);
+        time_stage("configuration interpolation", [&]() {
+            VectorTools::interpolate(*configuration_dof_handler, *configuration_evaluator, configuration);
+        }, configuration.size(), "dofs");
+        time_stage("configuration batch interpolation", [&]() {
+            interpolate_configuration(*configuration_evaluator);
+        }, configuration.size(), "dofs");
+
+        // the two products of the coupling, C y whit the scattered writes of SparseMatrix and whit the columns
+        // of the coupling operator
+        Vector<double> embedding_vector(solution.size()), embedded_vector(lambda.size());
+        embedding_vector = 1.;
+        embedded_vector = 1.;
+        const double coupling_flops = 2. * coupling_matrix.n_nonzero_elements();
+        time_stage("coupling vmult", [&]() { coupling_operator.vmult(embedding_vector, embedded_vector); },
+                   coupling_flops, "flops");
+        time_stage("coupling Tvmult sparse matrix", [&]() {
+            coupling_matrix.Tvmult(embedded_vector, embedding_vector);
+        }, coupling_flops, "flops");
+        time_stage("coupling Tvmult", [&]() { coupling_operator.Tvmult(embedded_vector, embedding_vector); },
+                   coupling_flops, "flops");
+
+        // one application of the schur complement, the factorization is not part of it
+        solve();
+        auto K = linear_operator(stiffnes_matrix);
+        auto Ct = linear_operator(coupling_operator);
+        auto C = transpose_operator(Ct);
+        auto K_inv = linear_operator(K, K_inv_umfpack);
+        const auto composed_S = C * K_inv * Ct;
+        const auto S = linear_operator(schur_operator);
+        Vector<double> schur_src(lambda), schur_dst(lambda.size());
+        time_stage("schur apply linear operators", [&]() { composed_S.vmult(schur_dst, schur_src); });
+        time_stage("schur apply", [&]() { schur_operator.vmult(schur_dst, schur_src); });
+        if (parameters.schur_preconditioner == "banded") {
+            time_stage("banded schur preconditioner setup", [&]() {
+                schur_preconditioner_ready = false;
+                setup_schur_preconditioner(S);
+            }, lambda.size(), "dofs");
+            if (schur_preconditioner.is_factorized())
+                time_stage("banded schur preconditioner apply", [&]() {
+                    schur_preconditioner.vmult(schur_dst, schur_src);
+                }, lambda.size(), "dofs");
+        }
+
+        time_stage("output", [&]() {
+            output();
+            wait_for_output();
+        });
+
+        record_statistics("microbenchmark");
+        return results;
+    }
+
+    template<int dim, int spacedim>
+    std::vector<std::map<std::string, double>>
+    DistributedLagrangeProblem<dim, spacedim>::read_sweep_variants() const {
+        std::vector<std::map<std::string, double>> variants;
+
+        // sets given directly in the parameter file
+        if (!parameters.sweep_constants.empty())
+            for (const auto &set : Utilities::split_string_list(parameters.sweep_constants, '|'))
+                variants.push_back(parse_constants(set));
+
+        // sets given in a csv file
+        if (!parameters.sweep_constants_file.empty()) {
+            std::ifstream file(parameters.sweep_constants_file);
+            AssertThrow(file, ExcFileNotOpen(parameters.sweep_constants_file));
+            std::string line;
+            std::getline(file, line);
+            const std::vector<std::string> names = Utilities::split_string_list(line, ',');
+            while (std::getline(file, line)) {
+                const std::vector<std::string> values = Utilities::split_string_list(line, ',');
+                if (values.empty())
+                    continue;
+                AssertThrow(values.size() == names.size(),
+                            ExcMessage("The line <" + line + "> of the sweep file does not have one value per constant."));
+                std::map<std::string, double> variant;
+                for (unsigned int i = 0; i < names.size(); ++i)
+                    variant[names[i]] = Utilities::string_to_double(values[i]);
+                variants.push_back(variant);
+            }
+        }
+        return variants;
+    }
+
+    template<int dim, int spacedim>
+    void DistributedLagrangeProblem<dim, spacedim>::run_sweep() {
+        // the embedding mesh, the stiffness matrix and its factorization are keep from the last cycle,
+        // only what depend on the embedded functions is done again for each set of constants
+        const auto variants = read_sweep_variants();
+
+        std::ofstream sweep_file(output_file("sweep_results.csv"));
+        sweep_file << "variant, constants, schur iterations, lambda l2 norm, wall time" << std::endl;
+
+        // constants of the configuration currently interpolated, the cycles use the ones of the definition
+        std::map<std::string, double> current_configuration_constants = configuration_definition.constants;
+
+        for (unsigned int v = 0; v < variants.size(); ++v) {
+            Timer timer;
+
+            // constants of the configuration of this variant: the ones of the definition replaced by the variant
+            std::map<std::string, double> configuration_constants = configuration_definition.constants;
+            for (const auto &constant : variants[v])
+                if (configuration_constants.count(constant.first) != 0)
+                    configuration_constants[constant.first] = constant.second;
+
+            // the configuration is only rebuild if it is not the one in memory ( a variant can move the curve
+            // and the next one bring it back)
+            const bool configuration_changed = (configuration_constants != current_configuration_constants);
+            if (configuration_changed) {
+                const auto variant_configuration = make_function<spacedim>(
+                        configuration_definition, configuration_constants, parameters.compiled_expressions);
+                // the mapping keep a reference to configuration so it move whit it
+                interpolate_configuration(*variant_configuration);
+                coulpling_system();
+                current_configuration_constants = configuration_constants;
+            }
+
+            const auto variant_value = make_function<spacedim>(sub_domain_value_definition, variants[v],
+                                                               parameters.compiled_expressions);
+            if (configuration_changed)
+                assemble_embedded_problem(*variant_value);
+            else
+                assemble_embedded_rhs(*variant_value);
             solve();
+            output("-sweep-" + Utilities::int_to_string(v, 4));
+            timer.stop();
+
+            std::string constants_text;
+            for (const auto &constant : variants[v])
+                constants_text += (constants_text.empty() ? "" : " ") + constant.first + "=" +
+                                  Utilities::to_string(constant.second);
+            deallog << "Sweep variant " << v << " (" << constants_text << "): "
+                    << schur_solver_control.last_step() << " Schur iterations, "
+                    << timer.wall_time() << " s" << std::endl;
+            sweep_file << v << ", " << constants_text << ", " << schur_solver_control.last_step() << ", "
+                       << lambda.l2_norm() << ", " << timer.wall_time() << std::endl;
+        }
+    }
 
+    template<int dim, int spacedim>
+    std::string DistributedLagrangeProblem<dim, spacedim>::output_file(const std::string &name) const {
+        if (parameters.output_directory.empty())
+            return name;
+        return parameters.output_directory + "/" + name;
+    }
+
+    // run independent probleme ( one per parameter file) at the same time on the available cores,
+    // return the number of instances that failed
+    template<int dim, int spacedim>
+    unsigned int run_batch(const std::vector<std::string> &parameter_files) {
+        using Problem = DistributedLagrangeProblem<dim, spacedim>;
+
+        // the ParameterAcceptor are global, so each instance get its own subsection "Instance i" and all the
+        // files are parsed together. The problem must be build right after its parameters so its functions
+        // and solver control end up in the same subsection.
+        std::vector<std::unique_ptr<typename Problem::Parameters>> parameters;
+        std::vector<std::unique_ptr<Problem>> problems;
+        std::stringstream batch_parameters;
+        for (unsigned int i = 0; i < parameter_files.size(); ++i) {
+            const std::string instance_name = "Instance " + Utilities::int_to_string(i);
+            parameters.push_back(std_cxx14::make_unique<typename Problem::Parameters>(instance_name));
+            problems.push_back(std_cxx14::make_unique<Problem>(*parameters.back()));
+
+            std::ifstream file(parameter_files[i]);
+            AssertThrow(file, ExcFileNotOpen(parameter_files[i]));
+            batch_parameters << "subsection " << instance_name << std::endl
+                             << file.rdbuf() << std::endl
+                             << "end" << std::endl;
+        }
+        ParameterAcceptor::declare_all_parameters();
+        ParameterAcceptor::prm.parse_input(batch_parameters);
+        ParameterAcceptor::parse_all_parameters();
+        std::ofstream used_parameters("used_parameters.prm");
+        ParameterAcceptor::prm.print_parameters(used_parameters, ParameterHandler::Text);
+
+        // two instances must not write in the same files
+        for (unsigned int i = 0; i < parameters.size(); ++i)
+            if (parameters[i]->output_directory.empty())
+                parameters[i]->output_directory = "instance-" + Utilities::int_to_string(i, 3);
+
+        std::atomic<unsigned int> n_failed(0);
+        Threads::TaskGroup<void> tasks;
+        for (unsigned int i = 0; i < problems.size(); ++i)
+            tasks += Threads::new_task(std::function<void()>([&problems, &parameter_files, &n_failed, i]() -> void {
+                // an instance that fail should not stop the others
+                try {
+                    problems[i]->run();
+                }
+                catch (std::exception &exc) {
+                    std::cerr << "Exception on processing " << parameter_files[i] << ": " << std::endl
+                              << exc.what() << std::endl;
+                    ++n_failed;
+                }
+            }));
+        tasks.join_all();
+        if (n_failed != 0)
+            std::cerr << n_failed << " of " << problems.size() << " instances failed" << std::endl;
+        return n_failed;
+    }
+
+    // lists of the values tested by the scaling benchmark, every combination is run whit the base parameter file
+    class BenchmarkParameters : public ParameterAcceptor {
+    public:
+        BenchmarkParameters();
+
+        // parameter file used for everything that is not changed by the benchmark ( empty = default values)
+        std::string base_parameter_file = "";
+        std::vector<unsigned int> embedding_refinements{3, 4, 5};
+        std::vector<unsigned int> embedded_refinements{10, 12};
+        std::vector<unsigned int> local_refinements{0};
+        std::vector<unsigned int> embedding_degrees{1};
+        std::vector<unsigned int> embedded_degrees{1};
+        // each combination is run whit each order of the embedding dofs
+        std::vector<std::string> embedding_renumberings{"none"};
+        // table whit one line per combination
+        std::string table_file = "benchmark.csv";
+
+        // number of time each stage is repeated by the microbenchmark
+        unsigned int microbenchmark_repetitions = 5;
+        // table whit one line per combination and per stage
+        std::string microbenchmark_table_file = "microbenchmark.csv";
+        // number of rows sorted by length together in the SELL-C-sigma copy of the stiffness matrix ( the
+        // solve is direct and never multiply by the stiffness matrix, so only the microbenchmark use it)
+        unsigned int sell_sorting_window = 32;
+    };
+
+    BenchmarkParameters::BenchmarkParameters() : ParameterAcceptor("/Benchmark/") {
+        add_parameter("Base parameter file", base_parameter_file);
+        add_parameter("Initial embedding space refinements", embedding_refinements);
+        add_parameter("Initial embedded space refinements", embedded_refinements);
+        add_parameter("Local refinements steps near embedded domain", local_refinements);
+        add_parameter("Embedding space finite element degrees", embedding_degrees);
+        add_parameter("Embedded space finite element degrees", embedded_degrees);
+        add_parameter("Embedding dof renumberings", embedding_renumberings, "", this->prm,
+                      Patterns::List(Patterns::Selection("none|Cuthill_McKee|hierarchical|king|minimum_degree")));
+        add_parameter("Table file", table_file);
+        add_parameter("Microbenchmark repetitions", microbenchmark_repetitions);
+        add_parameter("Microbenchmark table file", microbenchmark_table_file);
+        add_parameter("SELL sorting window", sell_sorting_window);
+    }
+
+    // every combination of the lists: embedding refinement, embedded refinement, local refinements,
+    // embedding degree and embedded degree
+    std::vector<std::array<unsigned int, 5>> benchmark_combinations(const BenchmarkParameters &benchmark) {
+        std::vector<std::array<unsigned int, 5>> combinations;
+        for (const unsigned int embedding_refinement : benchmark.embedding_refinements)
+            for (const unsigned int embedded_refinement : benchmark.embedded_refinements)
+                for (const unsigned int local_refinement : benchmark.local_refinements)
+                    for (const unsigned int embedding_degree : benchmark.embedding_degrees)
+                        for (const unsigned int embedded_degree : benchmark.embedded_degrees)
+                            combinations.push_back({{embedding_refinement, embedded_refinement, local_refinement,
+                                                     embedding_degree, embedded_degree}});
+        return combinations;
+    }
+
+    std::string read_base_parameters(const BenchmarkParameters &benchmark) {
+        if (benchmark.base_parameter_file.empty())
+            return "";
+        std::ifstream file(benchmark.base_parameter_file);
+        AssertThrow(file, ExcFileNotOpen(benchmark.base_parameter_file));
+        std::stringstream content;
+        content << file.rdbuf();
+        return content.str();
+    }
+
+    // parse the base parameters whit the values of one combination in the section of the instance,
+    // the Parameters and the probleme of the instance must already exist
+    template<int dim, int spacedim>
+    void parse_benchmark_instance(const std::string &instance_name, const std::string &base_parameters,
+                                  const std::array<unsigned int, 5> &combination, const std::string &renumbering) {
+        std::stringstream run_parameters;
+        run_parameters << "subsection " << instance_name << std::endl
+                       << base_parameters << std::endl
+                       << "subsection Distributed Lagrange<" << dim << "," << spacedim << ">" << std::endl
+                       << "set Initial embedding space refinement = " << combination[0] << std::endl
+                       << "set Initial embedded space refinement = " << combination[1] << std::endl
+                       << "set Local refinements steps near embedded domain = " << combination[2] << std::endl
+                       << "set Embedding space finite element degree = " << combination[3] << std::endl
+                       << "set Embedded space finite element degree = " << combination[4] << std::endl
+                       << "set Embedding dof renumbering = " << renumbering << std::endl
+                       << "end" << std::endl
+                       << "end" << std::endl;
+        ParameterAcceptor::declare_all_parameters();
+        ParameterAcceptor::prm.parse_input(run_parameters);
+        ParameterAcceptor::parse_all_parameters();
+    }
+
+    // run the probleme for each combination of the benchmark lists and write a table of the size,
+    // the time of each stage, the memory and the iterations
+    template<int dim, int spacedim>
+    void run_benchmark(const std::string &benchmark_file) {
+        using Problem = DistributedLagrangeProblem<dim, spacedim>;
+
+        BenchmarkParameters benchmark;
+        ParameterAcceptor::initialize(benchmark_file, "used_benchmark.prm");
+        const std::string base_parameters = read_base_parameters(benchmark);
+
+        // same columns for every run even if a section is not used
+        const std::vector<std::string> sections = {"setup grids and dofs", "Setup coupling", "Assemble System",
+                                                   "Assemble Coupling - Mass Matrix",
+                                                   "Assemble Coupling - Interpolation", "Assemble Embedded - Fused",
+                                                   "Solve", "Output results"};
+
+        std::ofstream table(benchmark.table_file);
+        table << "run,embedding refinement,embedded refinement,local refinements,embedding degree,"
+                 "embedded degree,embedding renumbering,active cells,embedding dofs,embedded dofs,stiffness nnz,"
+                 "coupling nnz,schur iterations,peak memory MB,u L2 error,u H1 error,lambda L2 error";
+        for (const auto &section : sections)
+            table << "," << section;
+        table << ",total wall" << std::endl;
+
+        const auto combinations = benchmark_combinations(benchmark);
+        bool peak_memory_reset = true;
+        for (unsigned int run = 0; run < combinations.size() * benchmark.embedding_renumberings.size(); ++run) {
+            const auto &combination = combinations[run % combinations.size()];
+            const std::string &renumbering = benchmark.embedding_renumberings[run / combinations.size()];
+
+            // the runs share the process, the peak memory of the biggest run would be reported for all the next ones
+            if (peak_memory_reset && !reset_peak_memory()) {
+                std::cerr << "The peak memory can not be reset, the peak memory column is the peak of the whole "
+                             "benchmark so far" << std::endl;
+                peak_memory_reset = false;
+            }
+
+            // a new instance section for each run, the runs before are already destroyed
+            const std::string instance_name = "Benchmark run " + Utilities::int_to_string(run);
+            typename Problem::Parameters parameters(instance_name);
+            Problem problem(parameters);
+            parse_benchmark_instance<dim, spacedim>(instance_name, base_parameters, combination, renumbering);
+
+            table << run;
+            for (const unsigned int value : combination)
+                table << "," << value;
+            table << "," << renumbering;
+
+            Timer timer;
+            try {
+                problem.run();
+            }
+            catch (std::exception &exc) {
+                // some combination are not valid ( embedded grid too coarse), go on whit the others
+                std::cerr << "Benchmark run " << run << " failed: " << exc.what() << std::endl;
+                table << ",failed" << std::endl;
+                continue;
+            }
+            timer.stop();
+
+            // size at the end of the last cycle, time summed on the whole run
+            const auto &statistics = problem.get_statistics();
+            const auto &last = statistics.back();
+            table << "," << last.n_active_cells << "," << last.n_dofs << "," << last.n_dofs_sub << ","
+                  << last.stiffness_nnz << "," << last.coupling_nnz << "," << last.schur_iterations << ","
+                  << last.peak_memory / 1024. << "," << last.errors[0] << "," << last.errors[1] << ","
+                  << last.errors[2];
+            for (const auto &section : sections) {
+                double wall_time = 0;
+                for (const auto &stage : statistics)
+                    if (stage.sections.count(section) != 0)
+                        wall_time += stage.sections.at(section)[1];
+                table << "," << wall_time;
+            }
+            table << "," << timer.wall_time() << std::endl;
+        }
+    }
+
+    // time each stage alone for each combination of the benchmark lists, so the growth of each stage
+    // whit the size of the probleme can be compare between implementations
+    template<int dim, int spacedim>
+    void run_microbenchmark(const std::string &benchmark_file) {
+        using Problem = DistributedLagrangeProblem<dim, spacedim>;
+
+        BenchmarkParameters benchmark;
+        ParameterAcceptor::initialize(benchmark_file, "used_benchmark.prm");
+        const std::string base_parameters = read_base_parameters(benchmark);
+
+        std::ofstream table(benchmark.microbenchmark_table_file);
+        table << "run,embedding refinement,embedded refinement,local refinements,embedding degree,"
+                 "embedded degree,embedding renumbering,embedding dofs,embedded dofs,stage,min wall,mean wall,"
+                 "work,work unit,work per second,bytes,GB per second" << std::endl;
+
+        const auto combinations = benchmark_combinations(benchmark);
+        for (unsigned int run = 0; run < combinations.size() * benchmark.embedding_renumberings.size(); ++run) {
+            const auto &combination = combinations[run % combinations.size()];
+            const std::string &renumbering = benchmark.embedding_renumberings[run / combinations.size()];
+
+            const std::string instance_name = "Microbenchmark run " + Utilities::int_to_string(run);
+            typename Problem::Parameters parameters(instance_name);
+            Problem problem(parameters);
+            parse_benchmark_instance<dim, spacedim>(instance_name, base_parameters, combination, renumbering);
+
+            std::vector<typename Problem::StageTiming> results;
+            try {
+                results = problem.microbenchmark(benchmark.microbenchmark_repetitions, benchmark.sell_sorting_window);
+            }
+            catch (std::exception &exc) {
+                std::cerr << "Microbenchmark run " << run << " failed: " << exc.what() << std::endl;
+                continue;
+            }
+
+            const auto &sizes = problem.get_statistics().back();
+            for (const auto &result : results) {
+                table << run;
+                for (const unsigned int value : combination)
+                    table << "," << value;
+                table << "," << renumbering << "," << sizes.n_dofs << "," << sizes.n_dofs_sub << ","
+                      << result.stage << "," << result.min_wall << "," << result.mean_wall << "," << result.work
+                      << "," << result.work_unit << "," << (result.work > 0 ? result.work / result.min_wall : 0.)
+                      << "," << result.bytes << ","
+                      << (result.bytes > 0 ? result.bytes / result.min_wall / 1e9 : 0.) << std::endl;
+            }
         }
-        output();
     }
 }
 
@@ -543,7 +2697,25 @@ int main (int argc, char **argv) {
     try {
         using namespace dealii;
         using namespace mystep60;
+        // needed by the hdf5 output, also work when deal.II has no MPI
+        Utilities::MPI::MPI_InitFinalize mpi_initialization(argc, argv);
         const unsigned int dim = 1, spacedim = 2;
+        // scaling benchmark over the refinement parameters and the degrees
+        if (argc > 1 && std::string(argv[1]) == "--benchmark") {
+            run_benchmark<dim, spacedim>(argc > 2 ? argv[2] : "benchmark.prm");
+            return 0;
+        }
+        // each stage of the pipeline timed alone for the same combinations
+        if (argc > 1 && std::string(argv[1]) == "--microbenchmark") {
+            run_microbenchmark<dim, spacedim>(argc > 2 ? argv[2] : "benchmark.prm");
+            return 0;
+        }
+        // many parameter files: batch of independent instance
+        if (argc > 2) {
+            // a batch whit failed instances must not look like a success to the scripts
+            const unsigned int n_failed = run_batch<dim, spacedim>(std::vector<std::string>(argv + 1, argv + argc));
+            return (n_failed == 0 ? 0 : 3);
+        }
         DistributedLagrangeProblem<dim, spacedim>::Parameters parameters;
         DistributedLagrangeProblem<dim, spacedim> problem(parameters);
         std::string parameter_file;
@@ -0,0 +1,190 @@
+#ifndef MYSTEP60_PERF_COUNTERS_H
+#define MYSTEP60_PERF_COUNTERS_H
+
+// hardware counters ( cycles, instructions, cache and branch misses) of the sections of mystep_60V2 read whit
+// the linux perf_event_open interface. The counters are optional: if the kernel refuse them ( perf_event_paranoid,
+// container, other OS) open() return false and the scopes do nothing. When there are more events than hardware
+// counters the kernel multiplex them, each count is then scaled by the time the event was enabled over the time
+// it was really counted.
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <map>
+#include <ostream>
+#include <string>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace mystep60 {
+
+    class PerfCounters {
+    public:
+        static constexpr unsigned int n_events = 5;
+
+        // raw count of an event whit the time it was enabled and the time it was really counted
+        struct Reading {
+            std::uint64_t value = 0;
+            std::uint64_t time_enabled = 0;
+            std::uint64_t time_running = 0;
+        };
+        using Readings = std::array<Reading, n_events>;
+
+    private:
+        // events counted in one section since the start of the program, scaled for the multiplexing
+        struct Section {
+            Readings start{};
+            std::array<double, n_events> total{};
+            std::chrono::steady_clock::time_point start_time;
+            double wall_time = 0;
+            unsigned int n_calls = 0;
+        };
+
+    public:
+        PerfCounters() {
+            files.fill(-1);
+        }
+
+        ~PerfCounters() {
+            close_all();
+        }
+
+        PerfCounters(const PerfCounters &) = delete;
+
+        PerfCounters &operator=(const PerfCounters &) = delete;
+
+        // open the counters of the calling thread, the counts of the threads created after are added
+        // when they end ( the threads of the task pool usually live until the end of the program)
+        bool open() {
+#ifdef __linux__
+            const std::array<std::uint64_t, n_events> configs = {
+                    {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_REFERENCES,
+                     PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES}};
+            for (unsigned int i = 0; i < n_events; ++i) {
+                perf_event_attr attributes;
+                std::memset(&attributes, 0, sizeof(attributes));
+                attributes.type = PERF_TYPE_HARDWARE;
+                attributes.size = sizeof(attributes);
+                attributes.config = configs[i];
+                attributes.inherit = 1;
+                attributes.exclude_kernel = 1;
+                attributes.exclude_hv = 1;
+                attributes.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+                files[i] = static_cast<int>(syscall(__NR_perf_event_open, &attributes, 0, -1, -1, 0));
+                if (files[i] < 0) {
+                    close_all();
+                    return false;
+                }
+            }
+            return true;
+#else
+            return false;
+#endif
+        }
+
+        bool is_open() const {
+            return files[0] >= 0;
+        }
+
+        Readings read_values() const {
+            Readings readings{};
+#ifdef __linux__
+            for (unsigned int i = 0; i < n_events; ++i) {
+                // value, time enabled, time running in the order of read_format
+                std::uint64_t data[3];
+                if (files[i] >= 0 && ::read(files[i], data, sizeof(data)) == sizeof(data)) {
+                    readings[i].value = data[0];
+                    readings[i].time_enabled = data[1];
+                    readings[i].time_running = data[2];
+                }
+            }
+#endif
+            return readings;
+        }
+
+        // count of an event between two readings, extrapolated to the whole time when the event was only
+        // counted part of it, 0 if it was never counted
+        static double scaled_count(const Reading &start, const Reading &end) {
+            const double running = end.time_running - start.time_running;
+            const double enabled = end.time_enabled - start.time_enabled;
+            if (running <= 0)
+                return 0.;
+            return (end.value - start.value) * (enabled > running ? enabled / running : 1.);
+        }
+
+        // count the events between the construction and the destruction in a section, do nothing
+        // when the counters are not open
+        class Scope {
+        public:
+            Scope(PerfCounters &counters, const std::string &section_name)
+                    : counters(counters), section(counters.is_open() ? &counters.sections[section_name] : nullptr) {
+                if (section != nullptr) {
+                    section->start = counters.read_values();
+                    section->start_time = std::chrono::steady_clock::now();
+                }
+            }
+
+            ~Scope() {
+                if (section != nullptr) {
+                    const Readings end = counters.read_values();
+                    for (unsigned int i = 0; i < n_events; ++i)
+                        section->total[i] += scaled_count(section->start[i], end[i]);
+                    section->wall_time += std::chrono::duration<double>(
+                            std::chrono::steady_clock::now() - section->start_time).count();
+                    ++section->n_calls;
+                }
+            }
+
+        private:
+            PerfCounters &counters;
+            Section *section;
+        };
+
+        // table of the counters of each section, the bandwidth is estimated from the last level cache misses
+        // ( one line of 64 bytes each), the uncore counters of the memory controller need root
+        void print(std::ostream &out) const {
+            const auto precision = out.precision();
+            out << std::endl << "Hardware counters ( calling thread)" << std::endl
+                << std::left << std::setw(36) << "section" << std::right << std::setw(8) << "calls"
+                << std::setw(14) << "instructions" << std::setw(8) << "IPC" << std::setw(14) << "cache miss %"
+                << std::setw(18) << "branch miss/kinst" << std::setw(12) << "est. GB/s" << std::endl;
+            for (const auto &named_section : sections) {
+                const Section &section = named_section.second;
+                const double cycles = section.total[0], instructions = section.total[1];
+                const double references = section.total[2], misses = section.total[3];
+                const double branch_misses = section.total[4];
+                out << std::left << std::setw(36) << named_section.first << std::right << std::setw(8)
+                    << section.n_calls << std::setw(14) << static_cast<std::uint64_t>(instructions) << std::fixed << std::setprecision(2)
+                    << std::setw(8) << (cycles > 0 ? instructions / cycles : 0.) << std::setw(14)
+                    << (references > 0 ? 100. * misses / references : 0.) << std::setw(18)
+                    << (instructions > 0 ? 1000. * branch_misses / instructions : 0.) << std::setw(12)
+                    << (section.wall_time > 0 ? 64. * misses / section.wall_time / 1e9 : 0.) << std::endl;
+                out.unsetf(std::ios_base::floatfield);
+            }
+            out.precision(precision);
+        }
+
+    private:
+        void close_all() {
+#ifdef __linux__
+            for (int &file : files)
+                if (file >= 0) {
+                    close(file);
+                    file = -1;
+                }
+#endif
+        }
+
+        std::array<int, n_events> files;
+        std::map<std::string, Section> sections;
+    };
+}
+
+#endif
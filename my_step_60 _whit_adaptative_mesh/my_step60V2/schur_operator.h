@@ -0,0 +1,67 @@
+#ifndef MYSTEP60_SCHUR_OPERATOR_H
+#define MYSTEP60_SCHUR_OPERATOR_H
+
+// schur complement S = C K^-1 Ct applied in a single vmult: Ct x, the solve whit the factorization of K and C y
+// are done in place in a work vector allocated once, instead of the temporary vectors created by the
+// composition of three LinearOperator at each application.
+
+#include <deal.II/lac/sparse_direct.h>
+#include <deal.II/lac/vector.h>
+
+#include "coupling_operator.h"
+
+namespace mystep60 {
+
+    class SchurOperator {
+    public:
+        using size_type = dealii::types::global_dof_index;
+
+        // the coupling and the factorization must live as long as the operator is used
+        void reinit(const CouplingOperator &coupling_operator, const dealii::SparseDirectUMFPACK &K_inverse) {
+            coupling = &coupling_operator;
+            K_inv = &K_inverse;
+            embedding_work.reinit(coupling->m());
+        }
+
+        size_type m() const {
+            return coupling->n();
+        }
+
+        size_type n() const {
+            return coupling->n();
+        }
+
+        void vmult(dealii::Vector<double> &dst, const dealii::Vector<double> &src) const {
+            coupling->vmult(embedding_work, src);
+            K_inv->solve(embedding_work);
+            coupling->Tvmult(dst, embedding_work);
+        }
+
+        void vmult_add(dealii::Vector<double> &dst, const dealii::Vector<double> &src) const {
+            coupling->vmult(embedding_work, src);
+            K_inv->solve(embedding_work);
+            coupling->Tvmult_add(dst, embedding_work);
+        }
+
+        // S is symmetric
+        void Tvmult(dealii::Vector<double> &dst, const dealii::Vector<double> &src) const {
+            vmult(dst, src);
+        }
+
+        void Tvmult_add(dealii::Vector<double> &dst, const dealii::Vector<double> &src) const {
+            vmult_add(dst, src);
+        }
+
+        std::size_t memory_consumption() const {
+            return sizeof(*this) + embedding_work.memory_consumption();
+        }
+
+    private:
+        const CouplingOperator *coupling = nullptr;
+        const dealii::SparseDirectUMFPACK *K_inv = nullptr;
+        // Ct x then K^-1 Ct x, on the embedding dofs
+        mutable dealii::Vector<double> embedding_work;
+    };
+}
+
+#endif
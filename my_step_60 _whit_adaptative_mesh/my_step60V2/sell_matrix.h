@@ -0,0 +1,147 @@
+#ifndef MYSTEP60_SELL_MATRIX_H
+#define MYSTEP60_SELL_MATRIX_H
+
+// copy of a SparseMatrix in the SELL-C-sigma format: the rows are sorted by length inside windows of sigma rows
+// then grouped by chunks of C rows, C being the width of VectorizedArray<double> ( 4 whit AVX2, 8 whit AVX-512).
+// Each chunk is stored column by column and padded to its longest row, so the product do C rows at the same
+// time whit one SIMD multiplication per column and a gather of the source vector.
+
+#include <deal.II/base/parallel.h>
+#include <deal.II/base/vectorization.h>
+#include <deal.II/lac/sparse_matrix.h>
+#include <deal.II/lac/vector.h>
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+namespace mystep60 {
+
+    class SellMatrix {
+    public:
+        using size_type = dealii::types::global_dof_index;
+        static constexpr unsigned int chunk_size = dealii::VectorizedArray<double>::n_array_elements;
+
+        // build the structure and copy the values, must be called again after each assembly of the matrix
+        void reinit(const dealii::SparseMatrix<double> &matrix, const unsigned int sorting_window) {
+            const dealii::SparsityPattern &sparsity = matrix.get_sparsity_pattern();
+            n_rows = matrix.m();
+            n_cols = matrix.n();
+            const size_type n_chunks = (n_rows + chunk_size - 1) / chunk_size;
+
+            // the longest rows first inside each window, so the rows of a chunk have almost the same length
+            rows.resize(n_chunks * chunk_size);
+            std::iota(rows.begin(), rows.begin() + n_rows, 0);
+            const size_type window = std::max<size_type>(sorting_window, 1);
+            for (size_type begin = 0; begin < n_rows; begin += window)
+                std::stable_sort(rows.begin() + begin, rows.begin() + std::min(begin + window, n_rows),
+                                 [&](const unsigned int a, const unsigned int b) {
+                                     return sparsity.row_length(a) > sparsity.row_length(b);
+                                 });
+            // the padding rows of the last chunk are not written
+            std::fill(rows.begin() + n_rows, rows.end(), dealii::numbers::invalid_unsigned_int);
+
+            chunk_start.assign(n_chunks + 1, 0);
+            for (size_type chunk = 0; chunk < n_chunks; ++chunk) {
+                unsigned int length = 0;
+                for (unsigned int lane = 0; lane < chunk_size; ++lane)
+                    if (rows[chunk * chunk_size + lane] != dealii::numbers::invalid_unsigned_int)
+                        length = std::max(length, sparsity.row_length(rows[chunk * chunk_size + lane]));
+                chunk_start[chunk + 1] = chunk_start[chunk] + length * chunk_size;
+            }
+
+            // the padding entries are zero and read the first entry of the source vector
+            values.assign(chunk_start.back(), 0.);
+            columns.assign(chunk_start.back(), 0);
+            for (size_type chunk = 0; chunk < n_chunks; ++chunk)
+                for (unsigned int lane = 0; lane < chunk_size; ++lane) {
+                    const unsigned int row = rows[chunk * chunk_size + lane];
+                    if (row == dealii::numbers::invalid_unsigned_int)
+                        continue;
+                    unsigned int k = 0;
+                    for (auto entry = matrix.begin(row); entry != matrix.end(row); ++entry, ++k) {
+                        values[chunk_start[chunk] + k * chunk_size + lane] = entry->value();
+                        columns[chunk_start[chunk] + k * chunk_size + lane] = entry->column();
+                    }
+                }
+        }
+
+        size_type m() const {
+            return n_rows;
+        }
+
+        size_type n() const {
+            return n_cols;
+        }
+
+        // number of stored values whit the padding
+        std::size_t n_stored_elements() const {
+            return values.size();
+        }
+
+        void vmult(dealii::Vector<double> &dst, const dealii::Vector<double> &src) const {
+            apply(dst, src, false);
+        }
+
+        void vmult_add(dealii::Vector<double> &dst, const dealii::Vector<double> &src) const {
+            apply(dst, src, true);
+        }
+
+        // the stiffness matrix is symmetric
+        void Tvmult(dealii::Vector<double> &dst, const dealii::Vector<double> &src) const {
+            apply(dst, src, false);
+        }
+
+        void Tvmult_add(dealii::Vector<double> &dst, const dealii::Vector<double> &src) const {
+            apply(dst, src, true);
+        }
+
+        // bytes read and written by one vmult whitout cache reuse of the source vector
+        double bytes_per_vmult() const {
+            return values.size() * (sizeof(double) + sizeof(unsigned int)) + rows.size() * sizeof(unsigned int) +
+                   (n_rows + n_cols) * sizeof(double);
+        }
+
+        std::size_t memory_consumption() const {
+            return sizeof(*this) + values.capacity() * sizeof(double) +
+                   (columns.capacity() + rows.capacity()) * sizeof(unsigned int) +
+                   chunk_start.capacity() * sizeof(std::size_t);
+        }
+
+    private:
+        void apply(dealii::Vector<double> &dst, const dealii::Vector<double> &src, const bool add) const {
+            const size_type n_chunks = chunk_start.size() - 1;
+            dealii::parallel::apply_to_subranges(size_type(0), n_chunks, [&](const size_type begin,
+                                                                            const size_type end) {
+                for (size_type chunk = begin; chunk < end; ++chunk) {
+                    dealii::VectorizedArray<double> sum, value, x;
+                    sum = 0.;
+                    for (std::size_t k = chunk_start[chunk]; k < chunk_start[chunk + 1]; k += chunk_size) {
+                        value.load(&values[k]);
+                        x.gather(src.begin(), &columns[k]);
+                        sum += value * x;
+                    }
+                    for (unsigned int lane = 0; lane < chunk_size; ++lane) {
+                        const unsigned int row = rows[chunk * chunk_size + lane];
+                        if (row != dealii::numbers::invalid_unsigned_int)
+                            dst(row) = (add ? dst(row) + sum[lane] : sum[lane]);
+                    }
+                }
+            }, grain_size);
+        }
+
+        // chunks done by one task
+        static constexpr unsigned int grain_size = 64;
+
+        size_type n_rows = 0;
+        size_type n_cols = 0;
+        // row of the matrix of each lane of each chunk
+        std::vector<unsigned int> rows;
+        // first value of each chunk
+        std::vector<std::size_t> chunk_start;
+        std::vector<double> values;
+        std::vector<unsigned int> columns;
+    };
+}
+
+#endif